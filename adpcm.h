@@ -0,0 +1,297 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Decoding of IMA ADPCM blocks (Wwise layout and the usual one),
+   shared by decode.c and wwise.c */
+#ifndef ADPCM_H
+#define ADPCM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cpu.h" /* CPU_DISPATCH,CPU_TARGET,CPU_* */
+
+/* IMA ADPCM step sizes (with their step indexes) as in specification,
+   X(index, step) for every one of them */
+#define ADPCM_STEPS(X) \
+    X(0, 7) X(1, 8) X(2, 9) X(3, 10) X(4, 11) X(5, 12) X(6, 13) X(7, 14) \
+    X(8, 16) X(9, 17) X(10, 19) X(11, 21) X(12, 23) X(13, 25) X(14, 28) \
+    X(15, 31) X(16, 34) X(17, 37) X(18, 41) X(19, 45) X(20, 50) X(21, 55) \
+    X(22, 60) X(23, 66) X(24, 73) X(25, 80) X(26, 88) X(27, 97) X(28, 107) \
+    X(29, 118) X(30, 130) X(31, 143) X(32, 157) X(33, 173) X(34, 190) \
+    X(35, 209) X(36, 230) X(37, 253) X(38, 279) X(39, 307) X(40, 337) \
+    X(41, 371) X(42, 408) X(43, 449) X(44, 494) X(45, 544) X(46, 598) \
+    X(47, 658) X(48, 724) X(49, 796) X(50, 876) X(51, 963) X(52, 1060) \
+    X(53, 1166) X(54, 1282) X(55, 1411) X(56, 1552) X(57, 1707) X(58, 1878) \
+    X(59, 2066) X(60, 2272) X(61, 2499) X(62, 2749) X(63, 3024) X(64, 3327) \
+    X(65, 3660) X(66, 4026) X(67, 4428) X(68, 4871) X(69, 5358) X(70, 5894) \
+    X(71, 6484) X(72, 7132) X(73, 7845) X(74, 8630) X(75, 9493) X(76, 10442) \
+    X(77, 11487) X(78, 12635) X(79, 13899) X(80, 15289) X(81, 16818) \
+    X(82, 18500) X(83, 20350) X(84, 22385) X(85, 24623) X(86, 27086) \
+    X(87, 29794) X(88, 32767)
+
+#define ADPCM_STEP(index, step) step,
+static const uint16_t stepTable[89] = {ADPCM_STEPS(ADPCM_STEP)};
+#undef ADPCM_STEP
+static const int8_t indexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+/* NOTE: every nibble is decoded with 2 table lookups:
+   difference of the sample for (step index, nibble) and the next step index,
+   tables are made by the compiler, so threads only read them */
+#define ADPCM_MAGNITUDE(step, nibble) (((step) >> 3) + \
+        ((nibble) & 4 ? (step) : 0) + ((nibble) & 2 ? (step) >> 1 : 0) + \
+        ((nibble) & 1 ? (step) >> 2 : 0))
+#define ADPCM_DIFFERENCE(step, nibble) ((nibble) & 8 ? \
+        -ADPCM_MAGNITUDE(step, nibble) : ADPCM_MAGNITUDE(step, nibble))
+#define ADPCM_DIFFERENCES(index, step) \
+    ADPCM_DIFFERENCE(step, 0), ADPCM_DIFFERENCE(step, 1), \
+    ADPCM_DIFFERENCE(step, 2), ADPCM_DIFFERENCE(step, 3), \
+    ADPCM_DIFFERENCE(step, 4), ADPCM_DIFFERENCE(step, 5), \
+    ADPCM_DIFFERENCE(step, 6), ADPCM_DIFFERENCE(step, 7), \
+    ADPCM_DIFFERENCE(step, 8), ADPCM_DIFFERENCE(step, 9), \
+    ADPCM_DIFFERENCE(step, 10), ADPCM_DIFFERENCE(step, 11), \
+    ADPCM_DIFFERENCE(step, 12), ADPCM_DIFFERENCE(step, 13), \
+    ADPCM_DIFFERENCE(step, 14), ADPCM_DIFFERENCE(step, 15),
+static const int32_t differenceTable[89*16] = {
+    ADPCM_STEPS(ADPCM_DIFFERENCES)};
+#undef ADPCM_DIFFERENCES
+#undef ADPCM_DIFFERENCE
+#undef ADPCM_MAGNITUDE
+
+/* the same changes as indexTable, kept in [0, 88] */
+#define ADPCM_NEXT(index, change) ((index) + (change) < 0 ? 0 : \
+        (index) + (change) > 88 ? 88 : (index) + (change))
+#define ADPCM_NEXTS(index, step) \
+    ADPCM_NEXT(index, -1), ADPCM_NEXT(index, -1), \
+    ADPCM_NEXT(index, -1), ADPCM_NEXT(index, -1), \
+    ADPCM_NEXT(index, 2), ADPCM_NEXT(index, 4), \
+    ADPCM_NEXT(index, 6), ADPCM_NEXT(index, 8), \
+    ADPCM_NEXT(index, -1), ADPCM_NEXT(index, -1), \
+    ADPCM_NEXT(index, -1), ADPCM_NEXT(index, -1), \
+    ADPCM_NEXT(index, 2), ADPCM_NEXT(index, 4), \
+    ADPCM_NEXT(index, 6), ADPCM_NEXT(index, 8),
+static const uint8_t nextIndexTable[89*16] = {ADPCM_STEPS(ADPCM_NEXTS)};
+#undef ADPCM_NEXTS
+#undef ADPCM_NEXT
+
+/* decodes one channel of one block:
+   4 bytes of header (predictor, step index, 0) and words-1 uint32 words
+   of nibbles, stride bytes apart, samples are written stride apart,
+   writes (words-1)*8+1 samples */
+static inline void decodeChannel(int16_t *out, size_t outStride,
+        const uint8_t *in, size_t inStride, size_t words)
+{
+    int32_t predictor = *(int16_t *)in;
+    uint32_t index = in[2] > 88 ? 88 : in[2];
+    *out = predictor;
+    out += outStride;
+    for(size_t w = 1; w < words; ++w)
+    {
+        const uint8_t *word = in + w*inStride;
+        for(size_t b = 0; b < 4; ++b)
+        {
+            /* low nibble is the first sample */
+            for(uint32_t nibble = word[b] & 0xf, n = 0; n < 2;
+                    ++n, nibble = word[b] >> 4)
+            {
+                predictor += differenceTable[index*16 + nibble];
+                if(predictor > 32767) predictor = 32767;
+                else if(predictor < -32768) predictor = -32768;
+                index = nextIndexTable[index*16 + nibble];
+                *out = predictor;
+                out += outStride;
+            }
+        }
+    }
+}
+
+/* layout of data of the file being decoded */
+struct adpcmFormat
+{
+    size_t channels, align, words; /* words of one channel in a block */
+    size_t samples; /* per block per channel */
+    /* 1 for Wwise files: clusters of words, one channel after another,
+       0 for IMA ADPCM: words of channels interleaved */
+    uint8_t clustered;
+};
+
+/* decodes blocks of ADPCM data to interleaved 16 bit samples */
+typedef void decodeFunction(int16_t *out, const uint8_t *in, size_t blocks,
+        const struct adpcmFormat *format);
+
+static inline void decodeBlocksGeneric(int16_t *out, const uint8_t *in,
+        size_t blocks, const struct adpcmFormat *format)
+{
+    size_t channels = format->channels;
+    for(size_t block = 0; block < blocks; ++block)
+    {
+        for(size_t s = 0; s < channels; ++s)
+        {
+            if(format->clustered)
+                decodeChannel(out + s, channels,
+                        in + s*format->words*4, 4, format->words);
+            else
+                decodeChannel(out + s, channels,
+                        in + s*4, channels*4, format->words);
+        }
+        in += format->align;
+        out += format->samples*channels;
+    }
+}
+
+#ifdef CPU_DISPATCH
+/* NOTE: every sample of a channel depends on the one before,
+   so vector versions decode the same channel of 8 (16) blocks at once,
+   one block in every lane, with the difference from differenceTable
+   gathered for all lanes, blocks that are left are decoded as usual */
+CPU_TARGET("avx2")
+static inline void decodeBlocksAvx2(int16_t *out, const uint8_t *in,
+        size_t blocks, const struct adpcmFormat *format)
+{
+    size_t channels = format->channels, words = format->words,
+           blockSamples = format->samples*channels;
+    const __m256i lanes = _mm256_mullo_epi32(
+            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+            _mm256_set1_epi32((int32_t)format->align));
+    /* indexTable, only 3 low bits of nibbles are used by permute */
+    const __m256i indexChange = _mm256_setr_epi32(-1, -1, -1, -1, 2, 4, 6, 8);
+    const __m256i nibbleMask = _mm256_set1_epi32(0xf),
+                  byteMask = _mm256_set1_epi32(0xff),
+                  zero = _mm256_setzero_si256(),
+                  lastIndex = _mm256_set1_epi32(88),
+                  sampleMax = _mm256_set1_epi32(32767),
+                  sampleMin = _mm256_set1_epi32(-32768);
+    int32_t samples[8];
+    for(; blocks >= 8; blocks -= 8, in += 8*format->align,
+            out += 8*blockSamples)
+        for(size_t s = 0; s < channels; ++s)
+        {
+            /* words of the channel are stride bytes apart */
+            const uint8_t *channel = format->clustered ?
+                in + s*words*4 : in + s*4;
+            size_t stride = format->clustered ? 4 : channels*4;
+            int16_t *o = out + s;
+            __m256i head = _mm256_i32gather_epi32((const int *)channel,
+                    lanes, 1);
+            __m256i predictor = _mm256_srai_epi32(
+                    _mm256_slli_epi32(head, 16), 16),
+                    index = _mm256_min_epi32(_mm256_and_si256(
+                                _mm256_srli_epi32(head, 16), byteMask),
+                            lastIndex);
+            _mm256_storeu_si256((__m256i *)samples, predictor);
+            for(size_t k = 0; k < 8; ++k) o[k*blockSamples] = samples[k];
+            o += channels;
+            for(size_t w = 1; w < words; ++w)
+            {
+                __m256i word = _mm256_i32gather_epi32(
+                        (const int *)(channel + w*stride), lanes, 1);
+                /* low nibble is the first sample */
+                for(size_t n = 0; n < 8; ++n, o += channels,
+                        word = _mm256_srli_epi32(word, 4))
+                {
+                    __m256i nibble = _mm256_and_si256(word, nibbleMask);
+                    predictor = _mm256_add_epi32(predictor,
+                            _mm256_i32gather_epi32(differenceTable,
+                                _mm256_add_epi32(_mm256_slli_epi32(index, 4),
+                                    nibble), 4));
+                    predictor = _mm256_min_epi32(
+                            _mm256_max_epi32(predictor, sampleMin), sampleMax);
+                    index = _mm256_add_epi32(index,
+                            _mm256_permutevar8x32_epi32(indexChange, nibble));
+                    index = _mm256_min_epi32(
+                            _mm256_max_epi32(index, zero), lastIndex);
+                    _mm256_storeu_si256((__m256i *)samples, predictor);
+                    for(size_t k = 0; k < 8; ++k)
+                        o[k*blockSamples] = samples[k];
+                }
+            }
+        }
+    decodeBlocksGeneric(out, in, blocks, format);
+}
+
+CPU_TARGET("avx512f")
+static inline void decodeBlocksAvx512(int16_t *out, const uint8_t *in,
+        size_t blocks, const struct adpcmFormat *format)
+{
+    size_t channels = format->channels, words = format->words,
+           blockSamples = format->samples*channels;
+    const __m512i lanes = _mm512_mullo_epi32(
+            _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                8, 9, 10, 11, 12, 13, 14, 15),
+            _mm512_set1_epi32((int32_t)format->align));
+    /* indexTable */
+    const __m512i indexChange = _mm512_setr_epi32(-1, -1, -1, -1, 2, 4, 6, 8,
+            -1, -1, -1, -1, 2, 4, 6, 8);
+    const __m512i nibbleMask = _mm512_set1_epi32(0xf),
+                  byteMask = _mm512_set1_epi32(0xff),
+                  zero = _mm512_setzero_si512(),
+                  lastIndex = _mm512_set1_epi32(88),
+                  sampleMax = _mm512_set1_epi32(32767),
+                  sampleMin = _mm512_set1_epi32(-32768);
+    int32_t samples[16];
+    for(; blocks >= 16; blocks -= 16, in += 16*format->align,
+            out += 16*blockSamples)
+        for(size_t s = 0; s < channels; ++s)
+        {
+            const uint8_t *channel = format->clustered ?
+                in + s*words*4 : in + s*4;
+            size_t stride = format->clustered ? 4 : channels*4;
+            int16_t *o = out + s;
+            __m512i head = _mm512_i32gather_epi32(lanes, channel, 1);
+            __m512i predictor = _mm512_srai_epi32(
+                    _mm512_slli_epi32(head, 16), 16),
+                    index = _mm512_min_epi32(_mm512_and_si512(
+                                _mm512_srli_epi32(head, 16), byteMask),
+                            lastIndex);
+            _mm512_storeu_si512(samples, predictor);
+            for(size_t k = 0; k < 16; ++k) o[k*blockSamples] = samples[k];
+            o += channels;
+            for(size_t w = 1; w < words; ++w)
+            {
+                __m512i word = _mm512_i32gather_epi32(lanes,
+                        channel + w*stride, 1);
+                for(size_t n = 0; n < 8; ++n, o += channels,
+                        word = _mm512_srli_epi32(word, 4))
+                {
+                    __m512i nibble = _mm512_and_si512(word, nibbleMask);
+                    predictor = _mm512_add_epi32(predictor,
+                            _mm512_i32gather_epi32(_mm512_add_epi32(
+                                    _mm512_slli_epi32(index, 4), nibble),
+                                differenceTable, 4));
+                    predictor = _mm512_min_epi32(
+                            _mm512_max_epi32(predictor, sampleMin), sampleMax);
+                    index = _mm512_add_epi32(index,
+                            _mm512_permutexvar_epi32(nibble, indexChange));
+                    index = _mm512_min_epi32(
+                            _mm512_max_epi32(index, zero), lastIndex);
+                    _mm512_storeu_si512(samples, predictor);
+                    for(size_t k = 0; k < 16; ++k)
+                        o[k*blockSamples] = samples[k];
+                }
+            }
+        }
+    decodeBlocksAvx2(out, in, blocks, format);
+}
+#endif /* CPU_DISPATCH */
+
+/* decode function of level of vector code (CPU_*),
+   SSE2 has no gathers, so it gets generic code */
+static inline decodeFunction *pickDecode(int level)
+{
+#ifdef CPU_DISPATCH
+    if(level >= CPU_AVX512) return decodeBlocksAvx512;
+    if(level >= CPU_AVX2) return decodeBlocksAvx2;
+#endif /* CPU_DISPATCH */
+    (void)level;
+    return decodeBlocksGeneric;
+}
+
+#endif /* ADPCM_H */
@@ -0,0 +1,142 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Blocks of one wave file read, changed and written by several threads
+   a batch at a time (-j), and finding chunks of wave files,
+   shared by decode.c and encode.c */
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "fileio.h" /* fileSeek,readAt */
+
+#if defined(__unix__) || defined(__APPLE__)
+/* blocks of one file are done by several threads (-j) */
+#define BATCH_THREADS 1
+#include <pthread.h>
+#endif /* __unix__ || __APPLE__ */
+
+/* blocks taken by a thread at once */
+#define BATCH_BLOCKS 256
+
+/* blocks of one file shared by threads */
+struct batchJob
+{
+    FILE *in, *out;
+    uint64_t inOffset, outOffset; /* of the first block */
+    size_t blocks, next;
+    uint8_t failed; /* 1 reading, 2 writing, 3 memory */
+#ifdef BATCH_THREADS
+    pthread_mutex_t lock;
+#endif /* BATCH_THREADS */
+};
+
+/* records failed of the calling thread (unless it is 0) and takes
+   the next batch, returns the number of its blocks and sets first to
+   the first of them, 0 when all blocks are taken or the job has failed */
+static inline size_t batchNext(struct batchJob *job, uint8_t failed,
+        size_t *first)
+{
+#ifdef BATCH_THREADS
+    pthread_mutex_lock(&job->lock);
+#endif /* BATCH_THREADS */
+    if(failed) job->failed = failed;
+    *first = job->next;
+    size_t blocks = job->failed || job->next >= job->blocks ? 0 :
+        job->blocks - job->next;
+    if(blocks > BATCH_BLOCKS) blocks = BATCH_BLOCKS;
+    job->next += blocks;
+#ifdef BATCH_THREADS
+    pthread_mutex_unlock(&job->lock);
+#endif /* BATCH_THREADS */
+    return blocks;
+}
+
+/* runs work(argument) on up to threads threads, this one included,
+   work takes batches of job with batchNext() until there is none left,
+   returns what batchJob.failed is */
+static inline uint8_t batchRun(struct batchJob *job,
+        void *(*work)(void *), void *argument, size_t threads)
+{
+#ifdef BATCH_THREADS
+    size_t batches = (job->blocks + BATCH_BLOCKS - 1) / BATCH_BLOCKS;
+    if(threads > batches) threads = batches;
+    pthread_t *thread = threads > 1 ? malloc((threads - 1)*sizeof(*thread)) : NULL;
+    size_t started = 0;
+    pthread_mutex_init(&job->lock, NULL);
+    for(; thread && started < threads - 1; ++started)
+    {
+        if(pthread_create(thread + started, NULL, work, argument)) break;
+    }
+    /* this thread works too, whatever is started */
+    work(argument);
+    for(size_t t = 0; t < started; ++t) pthread_join(thread[t], NULL);
+    free(thread);
+    pthread_mutex_destroy(&job->lock);
+#else
+    (void)threads;
+    work(argument);
+#endif /* BATCH_THREADS */
+    return job->failed;
+}
+
+/* skips chunks of RIFF file until chunkMark one, returns its length
+   with file at its data, 0 when there is no such chunk */
+static inline size_t findChunk(uint32_t chunkMark, FILE *file,
+        const char *fileName)
+{
+    size_t chunkLength = 0;
+    for(size_t ioStatus = 1; ioStatus > 0;)
+    {
+        uint32_t chunkHead[2];
+        ioStatus = fread(chunkHead, 1, 4*2, file);
+        if(ioStatus < 4*2)
+        {
+            fprintf(stderr, "%s: Can't find \"%.4s\" chunk.\n",
+                    fileName, (char *)&chunkMark);
+            break;
+        }
+        if(chunkHead[0] == chunkMark)
+        {
+            chunkLength = chunkHead[1];
+            return chunkLength;
+        }
+        if(fileSeek(file, chunkHead[1], SEEK_CUR))
+        {
+            fprintf(stderr, "%s: Can't read enough of file.\n", fileName);
+            break;
+        }
+    }
+    return chunkLength;
+}
+
+/* returns the first 4 bytes of data of chunkMark chunk of RIFF file
+   (number of samples of every channel of "fact" chunk), chunks are
+   searched from offset without moving position of the file,
+   0 when there is no such chunk */
+static inline uint32_t findChunkWord(uint32_t chunkMark, FILE *file,
+        uint64_t offset)
+{
+    uint32_t chunkHead[3];
+    while(readAt(file, chunkHead, 4*2, offset) == 4*2)
+    {
+        if(chunkHead[0] == chunkMark)
+            return chunkHead[1] >= 4 &&
+                readAt(file, chunkHead + 2, 4, offset + 8) == 4 ?
+                chunkHead[2] : 0;
+        offset += 8 + (uint64_t)chunkHead[1];
+    }
+    return 0;
+}
+
+#endif /* BATCH_H */
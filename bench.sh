@@ -0,0 +1,82 @@
+#!/bin/sh
+# Measures how fast tools are on the same generated data.
+# usage: ./bench.sh [size of test files in MiB] [seed] [directory with executables]
+# Test files are made by generate, the same size and seed give the same files,
+# so numbers from different machines and versions can be compared.
+# Reading the file with dd is shown for comparison,
+# it is as close to memory bandwidth as it gets for cached file.
+size=${1:-256}
+seed=${2:-1}
+bin=${3:-.}
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+now() { date +%s%N; }
+report() { # name, bytes, files, start, end
+    ns=$(($5 - $4)); [ $ns -gt 0 ] || ns=1
+    line="$1: $(($2/1048576)) MiB in $((ns/1000000)) ms, $(($2*1000000000/1048576/ns)) MiB/s"
+    [ "$3" -gt 0 ] && line="$line, $(($3*1000000000/ns)) files/s"
+    echo "$line"
+}
+bytes() { cat "$@" | wc -c; }
+
+# random data, (almost) no "RIFF" marks, the time is spent on reading and scanning
+head -c $((size*1024*1024)) /dev/urandom > "$dir/random" || exit 1
+cat "$dir/random" > /dev/null # warm up page cache
+start=$(now); dd if="$dir/random" of=/dev/null bs=1M 2>/dev/null; end=$(now)
+report "dd (reference)" $((size*1048576)) 0 $start $end
+start=$(now); "$bin/extract" "$dir/random" > /dev/null; end=$(now)
+report "extract scan" $((size*1048576)) 0 $start $end
+rm "$dir/random"
+
+# archive with Wwise IMA ADPCM files of 1, 2, 4, 6 and 8 channels,
+# 64 KiB on average, with decoy "RIFF" marks
+"$bin/generate" -s $seed -n $((size*16)) "$dir/archive" > /dev/null || exit 1
+archive=$(bytes "$dir/archive")
+mkdir "$dir/e" "$dir/t"
+cp "$dir/archive" "$dir/e/archive"
+start=$(now); "$bin/extract" -l "$dir/e/archive" > "$dir/e.txt"; end=$(now)
+report "extract -l" $archive $(wc -l < "$dir/e.txt") $start $end
+rm -f "$dir"/e/archive_*.wav
+start=$(now); "$bin/extract" -l -j 0 "$dir/e/archive" > "$dir/e.txt"; end=$(now)
+report "extract -l -j 0" $archive $(wc -l < "$dir/e.txt") $start $end
+files=$(wc -l < "$dir/e.txt")
+extracted=$(xargs cat < "$dir/e.txt" | wc -c)
+
+# data shuffling of multichannel files, done in memory
+"$bin/reformat" --benchmark
+start=$(now); xargs "$bin/reformat" -j 0 < "$dir/e.txt" > /dev/null; end=$(now)
+report "reformat -j 0" $extracted $files $start $end
+# decoys are extracted too and decode complains about them
+start=$(now); xargs "$bin/decode" -j 0 < "$dir/e.txt" > /dev/null 2>&1; end=$(now)
+report "decode -j 0" $extracted $files $start $end
+
+# end to end: archive to reformatted files
+cp "$dir/archive" "$dir/t/archive"
+start=$(now); "$bin/extract" -l -t -j 0 "$dir/t/archive" > /dev/null; end=$(now)
+report "extract -l -t -j 0" $archive $files $start $end
+rm -rf "$dir/e" "$dir/t"
+
+# decoding of the biggest file alone, blocks are decoded in parallel
+"$bin/decode" --benchmark
+"$bin/generate" -s $seed -n 1 -z $((size*256)) -c 2 -w 9 -d 0 "$dir/big.wav" > /dev/null
+big=$(bytes "$dir/big.wav")
+start=$(now); "$bin/decode" -j 0 "$dir/big.wav" > /dev/null; end=$(now)
+report "decode -j 0 (one file)" $big 1 $start $end
+# and back, the decoded file is encoded again
+"$bin/encode" --benchmark
+pcm=$(bytes "$dir/big_pcm.wav")
+start=$(now); "$bin/encode" -j 0 "$dir/big_pcm.wav" > /dev/null; end=$(now)
+report "encode -j 0 (one file)" $pcm 1 $start $end
+# one second far from the start, only its blocks are read
+start=$(now); "$bin/decode" -r $((size*2))s-$((size*2+1))s "$dir/big.wav" > /dev/null; end=$(now)
+echo "decode -r (one second of one file): $(((end - start)/1000)) us"
+if command -v sox > /dev/null; then
+    start=$(now)
+    "$bin/reformat" "$dir/big.wav" > /dev/null &&
+        sox "$dir/big.wav" -e signed-integer -b 16 "$dir/sox_pcm.wav" 2> /dev/null
+    end=$(now)
+    report "reformat + sox (one file)" $big 1 $start $end
+else
+    echo "reformat + sox: sox is not found"
+fi
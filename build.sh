@@ -2,7 +2,10 @@
 # Compile executables for and only for current machine,
 # produced executables may not work on other computers.
 # clang warnings are nicer, maybe
-clang  -o extract -march=native -mtune=native -O2 -fno-strict-aliasing -Wall -Wextra extract.c &&
-clang -o reformat -march=native -mtune=native -O2 -fno-strict-aliasing -Wall -Wextra reformat.c
+clang  -o extract -march=native -mtune=native -O2 -fno-strict-aliasing -Wall -Wextra -pthread extract.c wwise.c &&
+clang -o reformat -march=native -mtune=native -O2 -fno-strict-aliasing -Wall -Wextra -pthread reformat.c wwise.c &&
+clang  -o decode -march=native -mtune=native -O2 -fno-strict-aliasing -Wall -Wextra -pthread decode.c wwise.c &&
+clang  -o encode -march=native -mtune=native -O2 -fno-strict-aliasing -Wall -Wextra -pthread encode.c &&
+clang -o generate -march=native -mtune=native -O2 -fno-strict-aliasing -Wall -Wextra generate.c
 # example of usage:
 # /path/to/extract resources to extract from | xargs /path/to/reformat > log.log
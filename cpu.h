@@ -0,0 +1,72 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Choosing vector code when the program starts, so the same executable
+   is as fast as it gets on old and new processors:
+   every vectorized function is compiled for several levels
+   and the best one the processor supports is used (--cpu forces one) */
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdio.h>
+#include <string.h>
+
+/* NOTE: GCC and clang compile functions for instruction sets that are
+   not enabled for the rest of the program with target attribute,
+   other compilers and processors get generic code only */
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define CPU_DISPATCH 1
+#include <immintrin.h>
+#define CPU_TARGET(name) __attribute__((target(name)))
+#endif /* (__GNUC__ || __clang__) && (__x86_64__ || __i386__) */
+
+/* levels of vector code, every one includes the ones before it */
+#define CPU_GENERIC 0
+#define CPU_SSE2 1
+#define CPU_AVX2 2
+#define CPU_AVX512 3 /* AVX-512 F and BW */
+#define CPU_LEVELS 4
+
+static const char *const cpuNames[CPU_LEVELS] =
+    {"generic", "sse2", "avx2", "avx512"};
+
+/* returns the best level the processor (and the system) supports */
+static inline int cpuDetect(void)
+{
+#ifdef CPU_DISPATCH
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return CPU_AVX512;
+    if(__builtin_cpu_supports("avx2")) return CPU_AVX2;
+    if(__builtin_cpu_supports("sse2")) return CPU_SSE2;
+#endif /* CPU_DISPATCH */
+    return CPU_GENERIC;
+}
+
+/* returns level by its name (--cpu), -1 when there is no such level
+   or the processor doesn't support it, the error is printed */
+static inline int cpuParse(const char *name)
+{
+    int best = cpuDetect();
+    for(int level = 0; level < CPU_LEVELS; ++level)
+    {
+        if(strcmp(name, cpuNames[level]) != 0) continue;
+        if(level <= best) return level;
+        fprintf(stderr, "%s: Not supported by this processor, "
+                "the best is %s.\n", name, cpuNames[best]);
+        return -1;
+    }
+    fprintf(stderr, "%s: Unknown vector code, it can be generic, sse2, "
+            "avx2 or avx512 (up to %s here).\n", name, cpuNames[best]);
+    return -1;
+}
+
+#endif /* CPU_H */
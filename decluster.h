@@ -0,0 +1,165 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Data shuffling of multichannel Wwise IMA ADPCM blocks,
+   shared by extract.c and reformat.c */
+#ifndef DECLUSTER_H
+#define DECLUSTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cpu.h" /* CPU_DISPATCH,CPU_TARGET,CPU_* */
+
+/* NOTE: in Wwise files, when there is more then one channel,
+ * block of data is made of clusters, one for each channel,
+ * of words uint32 words each. Decluster functions put words of the block
+ * one channel after another, as IMA ADPCM specification requires:
+ *     out[n*channels+s] = in[s*words+n]
+ * that is transpose of channels x words matrix of uint32 */
+typedef void declusterFunction(uint32_t *out, const uint32_t *in,
+        size_t channels, size_t words);
+
+/* the way it was done originally, used by --benchmark for comparison */
+static inline void declusterReference(uint32_t *out, const uint32_t *in,
+        size_t channels, size_t words)
+{
+    size_t align = channels*words*4;
+    for(size_t n = 0; n < align/(channels*4); ++n)
+        for(size_t s = 0; s < channels; ++s)
+        {
+            out[n*channels+s] = in[s*align/(channels*4)+n];
+        }
+}
+
+static inline void declusterGeneric(uint32_t *out, const uint32_t *in,
+        size_t channels, size_t words)
+{
+    for(size_t s = 0; s < channels; ++s, ++out, in += words)
+        for(size_t n = 0; n < words; ++n)
+        {
+            out[n*channels] = in[n];
+        }
+}
+
+/* same as declusterGeneric, compiler knows the number of channels */
+static inline void decluster6(uint32_t *out, const uint32_t *in,
+        size_t channels, size_t words)
+{
+    (void)channels;
+    for(size_t n = 0; n < words; ++n, out += 6, ++in)
+    {
+        out[0] = in[0*words];
+        out[1] = in[1*words];
+        out[2] = in[2*words];
+        out[3] = in[3*words];
+        out[4] = in[4*words];
+        out[5] = in[5*words];
+    }
+}
+
+#ifdef CPU_DISPATCH
+CPU_TARGET("sse2")
+static inline void decluster2(uint32_t *out, const uint32_t *in,
+        size_t channels, size_t words)
+{
+    size_t n = 0;
+    for(; n + 4 <= words; n += 4, out += 8)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(in + n)),
+                b = _mm_loadu_si128((const __m128i *)(in + words + n));
+        _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi32(a, b));
+        _mm_storeu_si128((__m128i *)(out + 4), _mm_unpackhi_epi32(a, b));
+    }
+    for(; n < words; ++n, out += 2)
+    {
+        out[0] = in[n];
+        out[1] = in[words + n];
+    }
+    (void)channels;
+}
+
+/* transposes 4x4 words: 4 words of 4 channels starting from in[n],
+   clusters are stride words apart, rows of result are stride words apart */
+CPU_TARGET("sse2")
+static inline void transpose4(uint32_t *out, size_t outStride,
+        const uint32_t *in, size_t inStride)
+{
+    __m128i a = _mm_loadu_si128((const __m128i *)in),
+            b = _mm_loadu_si128((const __m128i *)(in + inStride)),
+            c = _mm_loadu_si128((const __m128i *)(in + 2*inStride)),
+            d = _mm_loadu_si128((const __m128i *)(in + 3*inStride));
+    __m128i ab0 = _mm_unpacklo_epi32(a, b), ab1 = _mm_unpackhi_epi32(a, b),
+            cd0 = _mm_unpacklo_epi32(c, d), cd1 = _mm_unpackhi_epi32(c, d);
+    _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi64(ab0, cd0));
+    _mm_storeu_si128((__m128i *)(out + outStride), _mm_unpackhi_epi64(ab0, cd0));
+    _mm_storeu_si128((__m128i *)(out + 2*outStride), _mm_unpacklo_epi64(ab1, cd1));
+    _mm_storeu_si128((__m128i *)(out + 3*outStride), _mm_unpackhi_epi64(ab1, cd1));
+}
+
+CPU_TARGET("sse2")
+static inline void decluster4(uint32_t *out, const uint32_t *in,
+        size_t channels, size_t words)
+{
+    size_t n = 0;
+    for(; n + 4 <= words; n += 4)
+    {
+        transpose4(out + n*4, 4, in + n, words);
+    }
+    for(; n < words; ++n)
+    {
+        out[n*4+0] = in[n];
+        out[n*4+1] = in[words + n];
+        out[n*4+2] = in[2*words + n];
+        out[n*4+3] = in[3*words + n];
+    }
+    (void)channels;
+}
+
+CPU_TARGET("sse2")
+static inline void decluster8(uint32_t *out, const uint32_t *in,
+        size_t channels, size_t words)
+{
+    size_t n = 0;
+    for(; n + 4 <= words; n += 4)
+    {
+        transpose4(out + n*8, 8, in + n, words);
+        transpose4(out + n*8 + 4, 8, in + 4*words + n, words);
+    }
+    for(; n < words; ++n)
+        for(size_t s = 0; s < 8; ++s)
+        {
+            out[n*8+s] = in[s*words + n];
+        }
+    (void)channels;
+}
+#endif /* CPU_DISPATCH */
+
+/* picks the fastest decluster function for the number of channels
+   that uses vector code up to level (CPU_*) */
+/* NOTE: AVX2 and AVX-512 get SSE2 code: 8x8 transposes with AVX2
+   were slower than 4x4 ones (cross-lane permutes cost more than they save
+   on clusters of 5 to 33 words), and clusters are too short for more */
+static inline declusterFunction *pickDecluster(size_t channels, int level)
+{
+    switch(channels)
+    {
+#ifdef CPU_DISPATCH
+    case 2: if(level >= CPU_SSE2) return decluster2; break;
+    case 4: if(level >= CPU_SSE2) return decluster4; break;
+    case 8: if(level >= CPU_SSE2) return decluster8; break;
+#endif /* CPU_DISPATCH */
+    case 6: return decluster6;
+    }
+    (void)level;
+    return declusterGeneric;
+}
+
+#endif /* DECLUSTER_H */
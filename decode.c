@@ -0,0 +1,568 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* 64 bit offsets of files on 32 bit systems too (see fileio.h) */
+#define _FILE_OFFSET_BITS 64
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu.h" /* cpuDetect,cpuParse,cpuNames */
+#include "adpcm.h" /* struct adpcmFormat,decodeBlocksGeneric,pickDecode */
+#include "wwise.h" /* wwiseDecoder*,wwiseCpuLevel,wwiseSetCpuLevel */
+#include "fileio.h" /* readAt,writeAt,fileTell */
+#include "batch.h" /* struct batchJob,batchNext,batchRun,findChunk,BATCH_BLOCKS */
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+/* blocks of one file are decoded by several threads (-j) */
+#define USE_THREADS 1
+#endif /* __unix__ || __APPLE__ */
+
+/* These macros let you assign 4 byte string to 4 byte integer and
+initialize static variable because the following line has undefined behavior and
+has to be executed at run time.
+    uint32_t riffMark = *(uint32_t *)"RIFF";
+This is just overkill for 4 bytes:
+    #includes <strings.h>
+    memcpy(&riffMark, "RIFF", 4);
+*/
+/* char,char,char,char */
+/* little endian */
+#define string4ToInt32LE(a,b,c,d)  \
+    (((a) &0xff) << 0*8) |         \
+    (((b) &0xff) << 1*8) |         \
+    (((c) &0xff) << 2*8) |         \
+    (((d) &0xff) << 3*8)
+/* big endian */
+#define string4ToInt32BE(a,b,c,d)  \
+    (((d) &0xff) << 0*8) |         \
+    (((c) &0xff) << 1*8) |         \
+    (((b) &0xff) << 2*8) |         \
+    (((a) &0xff) << 3*8)
+#undef string4ToInt32BE
+#define string4ToInt32(a,b,c,d) string4ToInt32LE(a,b,c,d)
+
+/* NOTE: relies on that pointers when cast from (uint8_t *) to (uint32_t *)
+and (uint16_t *)
+work as usual when dereferenced, which, as far as I can tell,
+is Undefined Behavior, and can be compiled in unexpected ways
+so, you should probably compile with -fno-strict-aliasing */
+
+/* number of threads decoding one file (-j) */
+static size_t optionThreads = 1;
+
+/* -r FROM-TO, samples of every channel or seconds (when it ends with "s"),
+   TO is not decoded, without TO the rest of the file is decoded */
+static uint8_t optionRange = 0;
+static double rangeFrom = 0, rangeTo = 0;
+static uint8_t rangeFromSeconds = 0, rangeToSeconds = 0, rangeToEnd = 0;
+
+/* the best one the processor supports, unless --cpu says otherwise */
+static decodeFunction *decodeBlocks = decodeBlocksGeneric;
+
+/* blocks of one file shared by decoding threads */
+struct decodeJob
+{
+    struct batchJob batch;
+    const struct adpcmFormat *format;
+    uint64_t pcmSize; /* bytes written, the last block can be cut */
+};
+
+/* thread function, decodes batches of blocks until there is none left */
+static void *decodeBatches(void *argument)
+{
+    struct decodeJob *job = argument;
+    const struct adpcmFormat *format = job->format;
+    size_t pcmBlock = format->samples*format->channels*2;
+    uint8_t *in = malloc(BATCH_BLOCKS*format->align);
+    int16_t *out = malloc(BATCH_BLOCKS*pcmBlock);
+    uint8_t failed = in == NULL || out == NULL ? 3 : 0;
+    size_t first, blocks;
+    while((blocks = batchNext(&job->batch, failed, &first)) > 0)
+    {
+        if(readAt(job->batch.in, in, blocks*format->align,
+                    job->batch.inOffset + (uint64_t)first*format->align) <
+                blocks*format->align)
+        {
+            failed = 1;
+        }
+        else
+        {
+            decodeBlocks(out, in, blocks, format);
+            size_t size = job->pcmSize - (uint64_t)first*pcmBlock <
+                blocks*pcmBlock ?
+                job->pcmSize - (uint64_t)first*pcmBlock : blocks*pcmBlock;
+            if(writeAt(job->batch.out, out, size,
+                        job->batch.outOffset + (uint64_t)first*pcmBlock) <
+                    size)
+                failed = 2;
+        }
+    }
+    free(in);
+    free(out);
+    return NULL;
+}
+
+/* returns FileName_pcm.wav (without ".wav" of FileName),
+   it has to be freed, NULL when there is not enough memory */
+static char *pcmName(const char *fileName)
+{
+    size_t nameLength = strlen(fileName);
+    char *outName = malloc(nameLength + 8 + 1);
+    if(outName == NULL) return NULL;
+    if(nameLength > 4 && strcmp(fileName + nameLength - 4, ".wav") == 0)
+        nameLength -= 4;
+    sprintf(outName, "%.*s_pcm.wav", (int)nameLength, fileName);
+    return outName;
+}
+
+/* fills 44 bytes of PCM wave header */
+static void pcmHeader(uint8_t *header, size_t channels, uint32_t rate,
+        uint32_t pcmLength)
+{
+    static uint32_t riffMark = string4ToInt32('R','I','F','F');
+    static uint32_t waveMark = string4ToInt32('W','A','V','E');
+    static uint32_t  fmtMark = string4ToInt32('f','m','t',' ');
+    static uint32_t dataMark = string4ToInt32('d','a','t','a');
+    *(uint32_t *)header = riffMark;
+    *(uint32_t *)(header+4) = 36 + pcmLength;
+    *(uint32_t *)(header+8) = waveMark;
+    *(uint32_t *)(header+12) = fmtMark;
+    *(uint32_t *)(header+16) = 16;
+    *(uint16_t *)(header+20) = 0x0001;
+    *(uint16_t *)(header+22) = channels;
+    *(uint32_t *)(header+24) = rate;
+    *(uint32_t *)(header+28) = rate*channels*2;
+    *(uint16_t *)(header+32) = channels*2;
+    *(uint16_t *)(header+34) = 16;
+    *(uint32_t *)(header+36) = dataMark;
+    *(uint32_t *)(header+40) = pcmLength;
+}
+
+/* decodes one file into FileName_pcm.wav (without ".wav" of FileName),
+   returns 1 when the program should stop, 2 when the file couldn't be
+   read as far as its header said (the output is removed), 0 otherwise */
+static int decodeFile(const char *fileName)
+{
+    static uint32_t riffMark = string4ToInt32('R','I','F','F');
+    static uint32_t waveMark = string4ToInt32('W','A','V','E');
+    static uint32_t  fmtMark = string4ToInt32('f','m','t',' ');
+    static uint32_t dataMark = string4ToInt32('d','a','t','a');
+    static uint32_t factMark = string4ToInt32('f','a','c','t');
+    FILE *file = fopen(fileName, "rb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "%s: Error opening file.\n", fileName);
+        return 0;
+    }
+    if(setvbuf(file, NULL, _IONBF, 0))
+    {
+        fprintf(stderr, "%s: Error using file?!\n", fileName);
+        fclose(file); return 0;
+    }
+    uint32_t magick[3] = {0,0,0};
+    if(fread(magick, 1, 4*3, file) < 4*3 ||
+            magick[0] != riffMark || magick[2] != waveMark)
+    {
+        fprintf(stderr, "%s: File is not RIFF WAVE file.\n", fileName);
+        fclose(file); return 0;
+    }
+    size_t fmtLength = findChunk(fmtMark, file, fileName);
+    uint8_t fmtDescription[24];
+    if(fmtLength < 20 || fmtLength > 24 ||
+            fread(fmtDescription, 1, fmtLength, file) < fmtLength)
+    {
+        fprintf(stderr, "%s: Can't read fmt chunk.\n", fileName);
+        fclose(file); return 0;
+    }
+    uint16_t formatID = *(uint16_t *)fmtDescription,
+             sampleBits = *(uint16_t *)(fmtDescription+14),
+             extraSize = *(uint16_t *)(fmtDescription+16);
+    struct adpcmFormat format;
+    format.channels = *(uint16_t *)(fmtDescription+2);
+    format.align = *(uint16_t *)(fmtDescription+12);
+    uint32_t rate = *(uint32_t *)(fmtDescription+4);
+    /* Wwise IMA ADPCM, or IMA ADPCM (reformatted one too) */
+    if(!(sampleBits == 4 && ((formatID == 0x0002 && extraSize == 6) ||
+                    (formatID == 0x0011 && extraSize >= 2))))
+    {
+        fprintf(stderr, "%s: File doesn't seem to be (Wwise) IMA ADPCM wave."
+                " It has format ID 0x%04x, bits per sample %u, "
+                "%u bytes of extra format info.\n",
+                fileName, formatID, sampleBits, extraSize);
+        fclose(file); return 0;
+    }
+    format.clustered = formatID == 0x0002;
+    format.words = format.channels ? format.align/(format.channels*4) : 0;
+    if(format.words < 2)
+    {
+        fprintf(stderr, "%s: Block of data is too small (%u bytes).\n",
+                fileName, (unsigned)format.align);
+        fclose(file); return 0;
+    }
+    format.samples = (format.words - 1)*8 + 1;
+    /* "data" is after "fmt " */
+    size_t dataLength = findChunk(dataMark, file, fileName);
+    int64_t dataPoint = fileTell(file);
+    if(dataLength == 0 || dataPoint < 0)
+    {
+        fprintf(stderr, "%s: File has no usable data...\n", fileName);
+        fclose(file); return 0;
+    }
+
+    /* NOTE: incomplete last block is not decoded */
+    size_t blocks = dataLength / format.align;
+    /* files cut short (extracted files can be) are decoded as far as
+       they go, the header tells how much is decoded */
+    int64_t fileSize = -1;
+    if(fileSeek(file, 0, SEEK_END) == 0) fileSize = fileTell(file);
+    if(fileSize < dataPoint)
+    {
+        fprintf(stderr, "%s: Can't read enough of file.\n", fileName);
+        fclose(file); return 0;
+    }
+    if((uint64_t)(fileSize - dataPoint)/format.align < blocks)
+    {
+        fprintf(stderr, "%s: File is shorter then its data chunk, "
+                "%llu blocks of %llu are decoded.\n", fileName,
+                (unsigned long long)(fileSize - dataPoint)/format.align,
+                (unsigned long long)blocks);
+        blocks = (fileSize - dataPoint)/format.align;
+    }
+    /* NOTE: "fact" chunk (encode writes it) tells how much samples
+       there are when the last block is filled up */
+    uint64_t samples = (uint64_t)blocks*format.samples;
+    uint32_t factSamples = findChunkWord(factMark, file, 12);
+    if(factSamples && factSamples < samples)
+    {
+        samples = factSamples;
+        blocks = (samples + format.samples - 1)/format.samples;
+    }
+    uint64_t pcmSize = samples*format.channels*2;
+    if(pcmSize > (uint32_t)-1 - 36)
+    {
+        fprintf(stderr, "%s: Decoded file would be too big for wave file.\n",
+                fileName);
+        fclose(file); return 0;
+    }
+    uint32_t pcmLength = pcmSize;
+
+    char *outName = pcmName(fileName);
+    if(outName == NULL)
+    {
+        fprintf(stderr, "Error allocating memory?!\nAborting.\n");
+        fclose(file); return 1;
+    }
+    FILE *fileWriter = fopen(outName, "w+b");
+    if(fileWriter == NULL || setvbuf(fileWriter, NULL, _IONBF, 0))
+    {
+        fprintf(stderr, "%s: Error creating file.\nAborting.\n", outName);
+        if(fileWriter) fclose(fileWriter);
+        free(outName); fclose(file); return 1;
+    }
+
+    uint8_t header[44];
+    pcmHeader(header, format.channels, rate, pcmLength);
+
+    int result = 0;
+    struct decodeJob job;
+    memset(&job, 0, sizeof(job));
+    job.batch.in = file;
+    job.batch.out = fileWriter;
+    job.batch.inOffset = dataPoint;
+    job.batch.outOffset = 44;
+    job.batch.blocks = blocks;
+    job.format = &format;
+    job.pcmSize = pcmSize;
+    if(writeAt(fileWriter, header, 44, 0) < 44)
+    {
+        job.batch.failed = 2;
+    }
+    else
+    {
+        batchRun(&job.batch, decodeBatches, &job, optionThreads);
+    }
+    if((fclose(fileWriter) != 0) | (job.batch.failed >= 2))
+    {
+        fprintf(stderr, "%s: Error writing file.\nAborting.\n", outName);
+        result = 1;
+    }
+    else if(job.batch.failed == 1)
+    {
+        /* NOTE: the header doesn't match what is decoded */
+        fprintf(stderr, "%s: Error reading file.\n", fileName);
+        remove(outName);
+        result = 2;
+    }
+    else
+    {
+        fprintf(stdout, "%s\n", outName);
+    }
+    free(outName);
+    fclose(file);
+    return result;
+}
+
+/* wwiseReadFunction for files */
+static size_t readFile(void *user, void *buffer, size_t size, uint64_t offset)
+{
+    return readAt(user, buffer, size, offset);
+}
+
+/* sample at value of -r */
+static uint64_t rangeSample(double value, uint8_t seconds, uint32_t rate)
+{
+    return seconds ? (uint64_t)(value*rate) : (uint64_t)value;
+}
+
+/* decodes samples of -r of one file into FileName_pcm.wav,
+   only blocks with them are read,
+   returns 1 when the program should stop, 2 when the file couldn't be
+   read (the output is removed), 0 otherwise */
+static int decodeRange(const char *fileName)
+{
+    FILE *file = fopen(fileName, "rb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "%s: Error opening file.\n", fileName);
+        return 0;
+    }
+    struct wwiseDecoder decoder;
+    int status = wwiseDecoderOpen(&decoder, readFile, file, 0);
+    if(status == 2)
+    {
+        fprintf(stderr, "Error allocating memory?!\nAborting.\n");
+        fclose(file); return 1;
+    }
+    if(status)
+    {
+        fprintf(stderr, "%s: File is not (Wwise) IMA ADPCM wave file "
+                "or it can't be read.\n", fileName);
+        fclose(file); return 0;
+    }
+    uint64_t first = rangeSample(rangeFrom, rangeFromSeconds, decoder.rate),
+             last = rangeToEnd ? decoder.samples :
+                 rangeSample(rangeTo, rangeToSeconds, decoder.rate);
+    if(last > decoder.samples) last = decoder.samples;
+    if(first > last) first = last;
+    size_t channels = decoder.channels;
+    uint64_t pcmSize = (last - first)*channels*2;
+    if(pcmSize > (uint32_t)-1 - 36)
+    {
+        fprintf(stderr, "%s: Decoded file would be too big for wave file.\n",
+                fileName);
+        wwiseDecoderClose(&decoder); fclose(file); return 0;
+    }
+
+    char *outName = pcmName(fileName);
+    /* about 1 MiB of samples at once */
+    size_t step = (1 << 20)/(channels*2) + 1;
+    int16_t *samples = malloc(step*channels*2);
+    if(outName == NULL || samples == NULL)
+    {
+        fprintf(stderr, "Error allocating memory?!\nAborting.\n");
+        free(outName); free(samples);
+        wwiseDecoderClose(&decoder); fclose(file); return 1;
+    }
+    FILE *fileWriter = fopen(outName, "w+b");
+    if(fileWriter == NULL || setvbuf(fileWriter, NULL, _IONBF, 0))
+    {
+        fprintf(stderr, "%s: Error creating file.\nAborting.\n", outName);
+        if(fileWriter) fclose(fileWriter);
+        free(outName); free(samples);
+        wwiseDecoderClose(&decoder); fclose(file); return 1;
+    }
+    uint8_t header[44];
+    pcmHeader(header, channels, decoder.rate, pcmSize);
+    uint8_t failed = writeAt(fileWriter, header, 44, 0) < 44 ? 2 : 0;
+    for(uint64_t sample = first; !failed && sample < last; )
+    {
+        size_t count = last - sample < step ? last - sample : step;
+        if(wwiseDecoderRead(&decoder, samples, sample, count) < count)
+            failed = 1;
+        else if(writeAt(fileWriter, samples, count*channels*2,
+                    44 + (sample - first)*channels*2) < count*channels*2)
+            failed = 2;
+        sample += count;
+    }
+    int result = 0;
+    if((fclose(fileWriter) != 0) | (failed == 2))
+    {
+        fprintf(stderr, "%s: Error writing file.\nAborting.\n", outName);
+        result = 1;
+    }
+    else if(failed == 1)
+    {
+        /* NOTE: the header doesn't match what is decoded */
+        fprintf(stderr, "%s: Unexpected end of file.\n", fileName);
+        remove(outName);
+        result = 2;
+    }
+    else
+    {
+        fprintf(stdout, "%s\n", outName);
+    }
+    free(outName);
+    free(samples);
+    wwiseDecoderClose(&decoder);
+    fclose(file);
+    return result;
+}
+
+/* sets -r from FROM-TO, returns 0 on success */
+static int parseRange(const char *text)
+{
+    char *numberEnd;
+    rangeFrom = strtod(text, &numberEnd);
+    if(numberEnd == text || rangeFrom < 0) return 1;
+    rangeFromSeconds = *numberEnd == 's';
+    text = numberEnd + rangeFromSeconds;
+    if(*text++ != '-') return 1;
+    rangeToEnd = *text == '\0';
+    if(rangeToEnd) return 0;
+    rangeTo = strtod(text, &numberEnd);
+    if(numberEnd == text || rangeTo < 0) return 1;
+    rangeToSeconds = *numberEnd == 's';
+    return numberEnd[rangeToSeconds] != '\0';
+}
+
+/* measures speed of decoding of the blocks in memory with every level
+   of vector code the processor supports,
+   Wwise layout, 2 channels, 36 bytes per channel,
+   returns 0 when results are the same */
+static int benchmark(void)
+{
+    static const size_t dataSize = 1 << 20, repeat = 64;
+    struct adpcmFormat format = {2, 72, 9, 65, 1};
+    size_t blocks = dataSize / format.align,
+           outSize = blocks*format.samples*format.channels*2;
+    uint8_t *in = malloc(dataSize);
+    int16_t *out = malloc(outSize), *check = malloc(outSize);
+    if(in == NULL || out == NULL || check == NULL)
+    {
+        fprintf(stderr, "Error allocating memory?!\n");
+        free(in); free(out); free(check);
+        return 1;
+    }
+    for(size_t n = 0; n < dataSize; ++n) in[n] = (n*2654435761u) >> 24;
+    int result = 0;
+    for(int level = 0; level <= cpuDetect(); ++level)
+    {
+        decodeFunction *decode = pickDecode(level);
+        /* NOTE: levels without their own code are not measured again */
+        if(level && decode == pickDecode(level - 1)) continue;
+        clock_t start = clock();
+        for(size_t r = 0; r < repeat; ++r) decode(out, in, blocks, &format);
+        double seconds = (double)(clock() - start)/CLOCKS_PER_SEC;
+        if(seconds <= 0) seconds = 1e-9;
+        if(level == 0) memcpy(check, out, outSize);
+        uint8_t wrong = memcmp(check, out, outSize) != 0;
+        result |= wrong;
+        printf("decode (%s): %.1f MB/s of ADPCM, %.1f million samples/s, "
+                "one thread%s\n", cpuNames[level],
+                (double)blocks*format.align*repeat/seconds/1e6,
+                (double)blocks*format.samples*format.channels*repeat/
+                seconds/1e6, wrong ? ", WRONG RESULT" : "");
+    }
+    free(in); free(out); free(check);
+    return result;
+}
+
+/* TODO: decode files of other IMA ADPCM flavors (3 bits per sample) */
+int main(int argc, char **argv)
+{
+    decodeBlocks = pickDecode(cpuDetect());
+    if(argc == 2 && strcmp(argv[1], "--benchmark") == 0)
+    {
+        return benchmark();
+    }
+    size_t i = 1;
+    for(; i < (size_t)argc && argv[i][0] == '-'; ++i)
+    {
+        if(strcmp(argv[i], "--") == 0)
+        {
+            ++i;
+            break;
+        }
+        else if(strcmp(argv[i], "--cpu") == 0 && i + 1 < (size_t)argc)
+        {
+            int level = cpuParse(argv[++i]);
+            if(level < 0) return -1;
+            decodeBlocks = pickDecode(level);
+            wwiseSetCpuLevel(level);
+        }
+        else if(strcmp(argv[i], "-j") == 0 && i + 1 < (size_t)argc)
+        {
+            char *numberEnd;
+            optionThreads = strtoul(argv[++i], &numberEnd, 10);
+            if(*numberEnd != '\0')
+            {
+                fprintf(stderr, "%s: Wrong number of threads.\n", argv[i]);
+                return -1;
+            }
+#ifdef USE_THREADS
+            if(optionThreads == 0) /* as much as there is processors */
+            {
+                long processors = sysconf(_SC_NPROCESSORS_ONLN);
+                optionThreads = processors > 0 ? processors : 1;
+            }
+#else
+            optionThreads = 1; /* not supported */
+#endif /* USE_THREADS */
+        }
+        else if(strcmp(argv[i], "-r") == 0 && i + 1 < (size_t)argc)
+        {
+            if(parseRange(argv[++i]))
+            {
+                fprintf(stderr, "%s: Wrong range, it is FROM-TO, "
+                        "like 1000-2000 or 1.5s-3s.\n", argv[i]);
+                return -1;
+            }
+            optionRange = 1;
+        }
+        else
+        {
+            fprintf(stderr, "%s: Unknown option.\n", argv[i]);
+            return -1;
+        }
+    }
+    /* NOTE: vector code is chosen before threads start, they only read it */
+    wwiseCpuLevel();
+    if(i >= (size_t)argc)
+    {
+        fprintf(stderr, "Usage: %s [-j N] [-r FROM-TO] [--cpu LEVEL] [--] FileName1 [FileName2...]\n"
+                "Decodes Wwise IMA ADPCM wave files (and IMA ADPCM wave files\n"
+                "changed by reformat) into 16 bit PCM wave files FileName_pcm.wav,\n"
+                "prints names of the decoded files.\n"
+                "  -j  decode blocks of a file with N threads, 0 is for one thread per processor\n"
+                "  -r  decode only samples from FROM to TO (without TO), reading only\n"
+                "      blocks with them, numbers ending with \"s\" are seconds (1.5s-3s),\n"
+                "      without TO samples up to the end are decoded (10s-), -j is not used\n"
+                "  --cpu  use vector code of LEVEL: generic, sse2, avx2 or avx512,\n"
+                "      instead of the best one the processor supports (for benchmarks)\n"
+                "%s --benchmark measures speed of decoding with every level.\n"
+                "Version r4\n"
+                , argv[0], argv[0]);
+        return -1;
+    }
+    int result = 0;
+    for(; i < (size_t)argc; ++i)
+    {
+        int status = optionRange ? decodeRange(argv[i]) : decodeFile(argv[i]);
+        if(status == 1) return 1;
+        /* NOTE: the rest of the files are decoded anyway */
+        if(status) result = 1;
+    }
+    return result;
+}
@@ -0,0 +1,321 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Finding extracted files that are the same as already extracted ones
+   by hash and length of their contents (extract -d),
+   the table of hashes is kept in a text file between runs */
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DEDUP_THREADS 1
+#include <pthread.h>
+#endif /* __unix__ || __APPLE__ */
+
+/* NOTE: the hash is xxHash64, it is fast (several GB/s) and it is good
+   enough with length to tell files apart, it is not cryptographic */
+#define HASH_PRIME1 0x9E3779B185EBCA87ull
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4Full
+#define HASH_PRIME3 0x165667B19E3779F9ull
+#define HASH_PRIME4 0x85EBCA77C2B2AE63ull
+#define HASH_PRIME5 0x27D4EB2F165667C5ull
+
+/* hash of bytes given in pieces */
+struct hashState
+{
+    uint64_t lane[4];
+    uint64_t length;
+    uint8_t tail[32]; /* incomplete stripe */
+    size_t tailLength;
+};
+
+static inline uint64_t hashRotate(uint64_t x, unsigned n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+static inline uint64_t hashRound(uint64_t lane, uint64_t word)
+{
+    return hashRotate(lane + word*HASH_PRIME2, 31)*HASH_PRIME1;
+}
+
+static inline void hashBegin(struct hashState *state)
+{
+    state->lane[0] = HASH_PRIME1 + HASH_PRIME2;
+    state->lane[1] = HASH_PRIME2;
+    state->lane[2] = 0;
+    state->lane[3] = -HASH_PRIME1;
+    state->length = 0;
+    state->tailLength = 0;
+}
+
+/* NOTE: relies on unaligned (uint64_t *) loads, as the rest of the program */
+static inline void hashStripes(struct hashState *state, const uint8_t *p,
+        size_t stripes)
+{
+    uint64_t a = state->lane[0], b = state->lane[1],
+             c = state->lane[2], d = state->lane[3];
+    for(; stripes; --stripes, p += 32)
+    {
+        a = hashRound(a, *(uint64_t *)p);
+        b = hashRound(b, *(uint64_t *)(p+8));
+        c = hashRound(c, *(uint64_t *)(p+16));
+        d = hashRound(d, *(uint64_t *)(p+24));
+    }
+    state->lane[0] = a; state->lane[1] = b;
+    state->lane[2] = c; state->lane[3] = d;
+}
+
+static inline void hashUpdate(struct hashState *state,
+        const uint8_t *data, size_t size)
+{
+    state->length += size;
+    if(state->tailLength)
+    {
+        size_t amount = 32 - state->tailLength;
+        if(amount > size) amount = size;
+        memcpy(state->tail + state->tailLength, data, amount);
+        state->tailLength += amount;
+        data += amount;
+        size -= amount;
+        if(state->tailLength < 32) return;
+        hashStripes(state, state->tail, 1);
+        state->tailLength = 0;
+    }
+    hashStripes(state, data, size/32);
+    state->tailLength = size%32;
+    memcpy(state->tail, data + size - state->tailLength, state->tailLength);
+}
+
+static inline uint64_t hashEnd(const struct hashState *state)
+{
+    uint64_t h;
+    if(state->length >= 32)
+    {
+        h = hashRotate(state->lane[0], 1) + hashRotate(state->lane[1], 7) +
+            hashRotate(state->lane[2], 12) + hashRotate(state->lane[3], 18);
+        for(size_t n = 0; n < 4; ++n)
+            h = (h ^ hashRound(0, state->lane[n]))*HASH_PRIME1 + HASH_PRIME4;
+    }
+    else
+    {
+        h = state->lane[2] + HASH_PRIME5;
+    }
+    h += state->length;
+    const uint8_t *p = state->tail, *end = p + state->tailLength;
+    for(; end - p >= 8; p += 8)
+        h = hashRotate(h ^ hashRound(0, *(uint64_t *)p), 27)*HASH_PRIME1 +
+            HASH_PRIME4;
+    if(end - p >= 4)
+    {
+        h = hashRotate(h ^ (*(uint32_t *)p*HASH_PRIME1), 23)*HASH_PRIME2 +
+            HASH_PRIME3;
+        p += 4;
+    }
+    for(; p < end; ++p)
+        h = hashRotate(h ^ (*p*HASH_PRIME5), 11)*HASH_PRIME1;
+    h ^= h >> 33;
+    h *= HASH_PRIME2;
+    h ^= h >> 29;
+    h *= HASH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t hashBytes(const uint8_t *data, size_t size)
+{
+    struct hashState state;
+    hashBegin(&state);
+    hashUpdate(&state, data, size);
+    return hashEnd(&state);
+}
+
+/* hashes of written files, kept in the text file of lines
+       hash length mode path
+   (hash is 16 hex digits, mode is 1 for files changed by -t, 0 otherwise),
+   lines added later replace earlier ones with the same hash, length and mode */
+struct dedupEntry
+{
+    uint64_t hash, length;
+    uint8_t mode;
+    char *path; /* NULL for empty entry */
+};
+
+struct dedupTable
+{
+    struct dedupEntry *entries;
+    size_t count, capacity; /* capacity is power of 2 */
+    FILE *file; /* lines are appended to it */
+    const char *fileName;
+#ifdef DEDUP_THREADS
+    pthread_mutex_t lock;
+#endif /* DEDUP_THREADS */
+};
+
+/* returns the entry with hash, length and mode or empty one where it goes */
+static inline struct dedupEntry *dedupSlot(struct dedupTable *table,
+        uint64_t hash, uint64_t length, uint8_t mode)
+{
+    size_t n = hash & (table->capacity - 1);
+    while(table->entries[n].path && !(table->entries[n].hash == hash &&
+                table->entries[n].length == length &&
+                table->entries[n].mode == mode))
+        n = (n + 1) & (table->capacity - 1);
+    return table->entries + n;
+}
+
+/* sets path of the entry, path is copied, returns 0 on success */
+static inline int dedupSet(struct dedupTable *table, uint64_t hash,
+        uint64_t length, uint8_t mode, const char *path)
+{
+    if((table->count + 1)*2 > table->capacity)
+    {
+        struct dedupEntry *old = table->entries;
+        size_t oldCapacity = table->capacity, capacity = oldCapacity*2;
+        struct dedupEntry *entries = calloc(capacity, sizeof(*entries));
+        if(entries == NULL) return 1;
+        table->entries = entries;
+        table->capacity = capacity;
+        for(size_t n = 0; n < oldCapacity; ++n)
+            if(old[n].path)
+                *dedupSlot(table, old[n].hash, old[n].length, old[n].mode) =
+                    old[n];
+        free(old);
+    }
+    size_t pathLength = strlen(path) + 1;
+    char *copy = malloc(pathLength);
+    if(copy == NULL) return 1;
+    memcpy(copy, path, pathLength);
+    struct dedupEntry *entry = dedupSlot(table, hash, length, mode);
+    if(entry->path == NULL) ++table->count;
+    free(entry->path);
+    entry->hash = hash;
+    entry->length = length;
+    entry->mode = mode;
+    entry->path = copy;
+    return 0;
+}
+
+/* reads the table from fileName (if there is one) and opens it
+   for adding new lines, returns 0 on success */
+static inline int dedupOpen(struct dedupTable *table, const char *fileName)
+{
+    table->entries = NULL;
+    table->count = table->capacity = 0;
+    table->fileName = fileName;
+#ifdef DEDUP_THREADS
+    pthread_mutex_init(&table->lock, NULL);
+#endif /* DEDUP_THREADS */
+    table->file = NULL;
+    table->capacity = 1024;
+    table->entries = calloc(table->capacity, sizeof(*table->entries));
+    if(table->entries == NULL)
+    {
+        fprintf(stderr, "Error allocating memory?!\n");
+        return 1;
+    }
+    FILE *file = fopen(fileName, "r");
+    if(file)
+    {
+        static char line[4096 + 64];
+        while(fgets(line, sizeof(line), file))
+        {
+            unsigned long long hash, length;
+            unsigned mode;
+            int pathStart = 0;
+            size_t lineLength = strlen(line);
+            if(lineLength && line[lineLength-1] == '\n') line[--lineLength] = '\0';
+            if(sscanf(line, "%16llx %llu %u %n", &hash, &length, &mode,
+                        &pathStart) < 3 || pathStart == 0) continue;
+            if(dedupSet(table, hash, length, mode, line + pathStart))
+            {
+                fprintf(stderr, "Error allocating memory?!\n");
+                fclose(file);
+                return 1;
+            }
+        }
+        fclose(file);
+    }
+    table->file = fopen(fileName, "a");
+    if(table->file == NULL)
+    {
+        fprintf(stderr, "%s: Error opening file.\n", fileName);
+        return 1;
+    }
+    return 0;
+}
+
+/* looks for the file with the same hash, length and mode,
+   returns copy of its path (to be freed) or NULL,
+   when there is none, path is added to the table */
+/* NOTE: file is added before it is written, so the same file found
+   by another thread is linked to the one that is being written */
+static inline char *dedupFind(struct dedupTable *table, uint64_t hash,
+        uint64_t length, uint8_t mode, const char *path)
+{
+    char *found = NULL;
+#ifdef DEDUP_THREADS
+    pthread_mutex_lock(&table->lock);
+#endif /* DEDUP_THREADS */
+    struct dedupEntry *entry = dedupSlot(table, hash, length, mode);
+    if(entry->path)
+    {
+        size_t pathLength = strlen(entry->path) + 1;
+        found = malloc(pathLength);
+        if(found) memcpy(found, entry->path, pathLength);
+    }
+    else if(strchr(path, '\n') == NULL && dedupSet(table, hash, length, mode, path) == 0)
+    {
+        fprintf(table->file, "%016llx %llu %u %s\n", (unsigned long long)hash,
+                (unsigned long long)length, mode, path);
+    }
+#ifdef DEDUP_THREADS
+    pthread_mutex_unlock(&table->lock);
+#endif /* DEDUP_THREADS */
+    return found;
+}
+
+/* replaces path of the file that can't be linked anymore */
+static inline void dedupReplace(struct dedupTable *table, uint64_t hash,
+        uint64_t length, uint8_t mode, const char *path)
+{
+#ifdef DEDUP_THREADS
+    pthread_mutex_lock(&table->lock);
+#endif /* DEDUP_THREADS */
+    if(strchr(path, '\n') == NULL && dedupSet(table, hash, length, mode, path) == 0)
+    {
+        fprintf(table->file, "%016llx %llu %u %s\n", (unsigned long long)hash,
+                (unsigned long long)length, mode, path);
+    }
+#ifdef DEDUP_THREADS
+    pthread_mutex_unlock(&table->lock);
+#endif /* DEDUP_THREADS */
+}
+
+/* writes new lines and frees the table, returns 0 on success */
+static inline int dedupClose(struct dedupTable *table)
+{
+    int result = 0;
+    if(table->file && (ferror(table->file) | fclose(table->file)))
+    {
+        fprintf(stderr, "%s: Error writing to a file.\n", table->fileName);
+        result = 1;
+    }
+    for(size_t n = 0; n < table->capacity; ++n) free(table->entries[n].path);
+    free(table->entries);
+    return result;
+}
+
+#endif /* DEDUP_H */
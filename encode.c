@@ -0,0 +1,754 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* 64 bit offsets of files on 32 bit systems too (see fileio.h) */
+#define _FILE_OFFSET_BITS 64
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu.h" /* CPU_DISPATCH,CPU_TARGET,CPU_*,cpuDetect,cpuParse */
+#include "adpcm.h" /* stepTable,struct adpcmFormat,decodeBlocksGeneric */
+#include "fileio.h" /* readAt,writeAt,fileTell */
+#include "batch.h" /* struct batchJob,batchNext,batchRun,findChunk,BATCH_BLOCKS */
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+/* blocks of one file are encoded by several threads (-j) */
+#define USE_THREADS 1
+#endif /* __unix__ || __APPLE__ */
+
+
+/* These macros let you assign 4 byte string to 4 byte integer and
+initialize static variable because the following line has undefined behavior and
+has to be executed at run time.
+    uint32_t riffMark = *(uint32_t *)"RIFF";
+This is just overkill for 4 bytes:
+    #includes <strings.h>
+    memcpy(&riffMark, "RIFF", 4);
+*/
+/* char,char,char,char */
+/* little endian */
+#define string4ToInt32LE(a,b,c,d)  \
+    (((a) &0xff) << 0*8) |         \
+    (((b) &0xff) << 1*8) |         \
+    (((c) &0xff) << 2*8) |         \
+    (((d) &0xff) << 3*8)
+/* big endian */
+#define string4ToInt32BE(a,b,c,d)  \
+    (((d) &0xff) << 0*8) |         \
+    (((c) &0xff) << 1*8) |         \
+    (((b) &0xff) << 2*8) |         \
+    (((a) &0xff) << 3*8)
+#undef string4ToInt32BE
+#define string4ToInt32(a,b,c,d) string4ToInt32LE(a,b,c,d)
+
+/* NOTE: relies on that pointers when cast from (uint8_t *) to (uint32_t *)
+and (uint16_t *)
+work as usual when dereferenced, which, as far as I can tell,
+is Undefined Behavior, and can be compiled in unexpected ways
+so, you should probably compile with -fno-strict-aliasing */
+
+/* number of threads encoding one file (-j) */
+static size_t optionThreads = 1;
+
+/* block of one channel is 36 bytes, as Wwise makes them:
+   4 bytes of header (the first sample, step index, 0)
+   and 8 uint32 words of nibbles */
+#define BLOCK_WORDS 9
+#define BLOCK_SAMPLES ((BLOCK_WORDS - 1)*8 + 1)
+
+/* stepTable as int32, for gathers */
+static int32_t stepSizes[89];
+
+/* returns nibble of sample for predictor and step index, as in
+   specification, predictor and index are changed the same way
+   decoder changes them */
+static inline uint32_t encodeSample(int32_t sample, int32_t *predictor,
+        uint32_t *index)
+{
+    int32_t step = stepSizes[*index],
+            difference = sample - *predictor;
+    uint32_t nibble = 0;
+    if(difference < 0)
+    {
+        nibble = 8;
+        difference = -difference;
+    }
+    if(difference >= step)
+    {
+        nibble |= 4;
+        difference -= step;
+    }
+    step >>= 1;
+    if(difference >= step)
+    {
+        nibble |= 2;
+        difference -= step;
+    }
+    step >>= 1;
+    if(difference >= step) nibble |= 1;
+    *predictor += differenceTable[*index*16 + nibble];
+    if(*predictor > 32767) *predictor = 32767;
+    else if(*predictor < -32768) *predictor = -32768;
+    *index = nextIndexTable[*index*16 + nibble];
+    return nibble;
+}
+
+/* NOTE: every block starts anew from its header, so step index
+   at the start of a block can be any, search functions try all 89
+   for BLOCK_SAMPLES samples of one channel and return the one
+   with the smallest sum of differences of decoded samples and samples,
+   the smallest index of the ones that are as good,
+   error is set to that sum */
+/* NOTE: the index with step close to the usual difference of samples
+   is tried first, it is good (or the best) most of the time,
+   so other indexes are dropped as soon as they are worse than it */
+typedef uint32_t searchFunction(const int32_t *samples, uint32_t *error);
+
+/* returns index with step as big as average difference of samples */
+static uint32_t guessIndex(const int32_t *samples)
+{
+    int32_t sum = 0;
+    for(size_t n = 1; n < BLOCK_SAMPLES; ++n)
+        sum += abs(samples[n] - samples[n - 1]);
+    uint32_t index = 0;
+    while(index < 88 && stepSizes[index] < sum/(BLOCK_SAMPLES - 1)) ++index;
+    return index;
+}
+
+/* NOTE: sums of differences are less then 65*65536,
+   so this is bigger then any */
+#define NO_ERROR_YET 0x7fffffff
+
+static uint32_t searchGeneric(const int32_t *samples, uint32_t *error)
+{
+    uint32_t guess = guessIndex(samples),
+             best = guess, bestError = NO_ERROR_YET;
+    for(uint32_t k = 0; k <= 89; ++k)
+    {
+        /* the guess, then all the others */
+        uint32_t start = k == 0 ? guess : k - 1;
+        if(k && start == guess) continue;
+        int32_t predictor = samples[0];
+        uint32_t index = start, sum = 0;
+        /* the rest can't make it better */
+        for(size_t n = 1; n < BLOCK_SAMPLES && sum <= bestError; ++n)
+        {
+            encodeSample(samples[n], &predictor, &index);
+            sum += abs(samples[n] - predictor);
+        }
+        if(sum < bestError || (sum == bestError && start < best))
+        {
+            bestError = sum;
+            best = start;
+        }
+    }
+    *error = bestError;
+    return best;
+}
+
+#ifdef CPU_DISPATCH
+/* NOTE: vector versions try 8 (16) step indexes at once, one in every
+   lane, step and difference of the sample are gathered for all lanes */
+CPU_TARGET("avx2")
+static uint32_t searchAvx2(const int32_t *samples, uint32_t *error)
+{
+    /* indexTable, only 3 low bits of nibbles are used by permute */
+    const __m256i indexChange = _mm256_setr_epi32(-1, -1, -1, -1, 2, 4, 6, 8);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                  zero = _mm256_setzero_si256(),
+                  one = _mm256_set1_epi32(1),
+                  two = _mm256_set1_epi32(2),
+                  four = _mm256_set1_epi32(4),
+                  eight = _mm256_set1_epi32(8),
+                  lastIndex = _mm256_set1_epi32(88),
+                  sampleMax = _mm256_set1_epi32(32767),
+                  sampleMin = _mm256_set1_epi32(-32768);
+    uint32_t guess = guessIndex(samples) & ~7u,
+             best = guess, bestError = NO_ERROR_YET, sums[8];
+    for(uint32_t k = 0; k <= 96; k += 8)
+    {
+        /* lanes of the guess, then all the others */
+        uint32_t start = k == 0 ? guess : k - 8;
+        if(k && start == guess) continue;
+        const __m256i bestSum = _mm256_set1_epi32((int32_t)bestError);
+        /* lanes after 88 try 88 again */
+        __m256i index = _mm256_min_epi32(_mm256_add_epi32(
+                    _mm256_set1_epi32((int32_t)start), lanes), lastIndex),
+                predictor = _mm256_set1_epi32(samples[0]),
+                sum = zero;
+        size_t n = 1;
+        for(; n < BLOCK_SAMPLES; ++n)
+        {
+            /* the rest can't make any lane better */
+            if(n % 8 == 0 && _mm256_movemask_epi8(
+                        _mm256_cmpgt_epi32(sum, bestSum)) == -1)
+                break;
+            __m256i sample = _mm256_set1_epi32(samples[n]),
+                    step = _mm256_i32gather_epi32(stepSizes, index, 4),
+                    difference = _mm256_sub_epi32(sample, predictor),
+                    nibble = _mm256_and_si256(
+                            _mm256_cmpgt_epi32(zero, difference), eight),
+                    less;
+            difference = _mm256_abs_epi32(difference);
+            /* less is set where difference < step, bit is not */
+            less = _mm256_cmpgt_epi32(step, difference);
+            nibble = _mm256_or_si256(nibble, _mm256_andnot_si256(less, four));
+            difference = _mm256_sub_epi32(difference,
+                    _mm256_andnot_si256(less, step));
+            step = _mm256_srli_epi32(step, 1);
+            less = _mm256_cmpgt_epi32(step, difference);
+            nibble = _mm256_or_si256(nibble, _mm256_andnot_si256(less, two));
+            difference = _mm256_sub_epi32(difference,
+                    _mm256_andnot_si256(less, step));
+            step = _mm256_srli_epi32(step, 1);
+            less = _mm256_cmpgt_epi32(step, difference);
+            nibble = _mm256_or_si256(nibble, _mm256_andnot_si256(less, one));
+
+            predictor = _mm256_add_epi32(predictor,
+                    _mm256_i32gather_epi32(differenceTable,
+                        _mm256_add_epi32(_mm256_slli_epi32(index, 4),
+                            nibble), 4));
+            predictor = _mm256_min_epi32(
+                    _mm256_max_epi32(predictor, sampleMin), sampleMax);
+            index = _mm256_add_epi32(index,
+                    _mm256_permutevar8x32_epi32(indexChange, nibble));
+            index = _mm256_min_epi32(_mm256_max_epi32(index, zero), lastIndex);
+            sum = _mm256_add_epi32(sum,
+                    _mm256_abs_epi32(_mm256_sub_epi32(sample, predictor)));
+        }
+        if(n < BLOCK_SAMPLES) continue;
+        _mm256_storeu_si256((__m256i *)sums, sum);
+        for(uint32_t lane = 0; lane < 8 && start + lane < 89; ++lane)
+            if(sums[lane] < bestError ||
+                    (sums[lane] == bestError && start + lane < best))
+            {
+                bestError = sums[lane];
+                best = start + lane;
+            }
+    }
+    *error = bestError;
+    return best;
+}
+
+CPU_TARGET("avx512f")
+static uint32_t searchAvx512(const int32_t *samples, uint32_t *error)
+{
+    /* indexTable */
+    const __m512i indexChange = _mm512_setr_epi32(-1, -1, -1, -1, 2, 4, 6, 8,
+            -1, -1, -1, -1, 2, 4, 6, 8);
+    const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                8, 9, 10, 11, 12, 13, 14, 15),
+                  zero = _mm512_setzero_si512(),
+                  one = _mm512_set1_epi32(1),
+                  two = _mm512_set1_epi32(2),
+                  four = _mm512_set1_epi32(4),
+                  eight = _mm512_set1_epi32(8),
+                  lastIndex = _mm512_set1_epi32(88),
+                  sampleMax = _mm512_set1_epi32(32767),
+                  sampleMin = _mm512_set1_epi32(-32768);
+    uint32_t guess = guessIndex(samples) & ~15u,
+             best = guess, bestError = NO_ERROR_YET, sums[16];
+    for(uint32_t k = 0; k <= 96; k += 16)
+    {
+        uint32_t start = k == 0 ? guess : k - 16;
+        if(k && start == guess) continue;
+        const __m512i bestSum = _mm512_set1_epi32((int32_t)bestError);
+        __m512i index = _mm512_min_epi32(_mm512_add_epi32(
+                    _mm512_set1_epi32((int32_t)start), lanes), lastIndex),
+                predictor = _mm512_set1_epi32(samples[0]),
+                sum = zero;
+        size_t n = 1;
+        for(; n < BLOCK_SAMPLES; ++n)
+        {
+            if(n % 8 == 0 &&
+                    _mm512_cmpgt_epi32_mask(sum, bestSum) == 0xffff)
+                break;
+            __m512i sample = _mm512_set1_epi32(samples[n]),
+                    step = _mm512_i32gather_epi32(index, stepSizes, 4),
+                    difference = _mm512_sub_epi32(sample, predictor),
+                    nibble = _mm512_maskz_mov_epi32(
+                            _mm512_cmplt_epi32_mask(difference, zero), eight);
+            difference = _mm512_abs_epi32(difference);
+            __mmask16 bit = _mm512_cmpge_epi32_mask(difference, step);
+            nibble = _mm512_mask_or_epi32(nibble, bit, nibble, four);
+            difference = _mm512_mask_sub_epi32(difference, bit,
+                    difference, step);
+            step = _mm512_srli_epi32(step, 1);
+            bit = _mm512_cmpge_epi32_mask(difference, step);
+            nibble = _mm512_mask_or_epi32(nibble, bit, nibble, two);
+            difference = _mm512_mask_sub_epi32(difference, bit,
+                    difference, step);
+            step = _mm512_srli_epi32(step, 1);
+            bit = _mm512_cmpge_epi32_mask(difference, step);
+            nibble = _mm512_mask_or_epi32(nibble, bit, nibble, one);
+
+            predictor = _mm512_add_epi32(predictor,
+                    _mm512_i32gather_epi32(_mm512_add_epi32(
+                            _mm512_slli_epi32(index, 4), nibble),
+                        differenceTable, 4));
+            predictor = _mm512_min_epi32(
+                    _mm512_max_epi32(predictor, sampleMin), sampleMax);
+            index = _mm512_add_epi32(index,
+                    _mm512_permutexvar_epi32(nibble, indexChange));
+            index = _mm512_min_epi32(_mm512_max_epi32(index, zero), lastIndex);
+            sum = _mm512_add_epi32(sum,
+                    _mm512_abs_epi32(_mm512_sub_epi32(sample, predictor)));
+        }
+        if(n < BLOCK_SAMPLES) continue;
+        _mm512_storeu_si512(sums, sum);
+        for(uint32_t lane = 0; lane < 16 && start + lane < 89; ++lane)
+            if(sums[lane] < bestError ||
+                    (sums[lane] == bestError && start + lane < best))
+            {
+                bestError = sums[lane];
+                best = start + lane;
+            }
+    }
+    *error = bestError;
+    return best;
+}
+#endif /* CPU_DISPATCH */
+
+/* search function of level of vector code (CPU_*),
+   SSE2 has no gathers, so it gets generic code */
+static searchFunction *pickSearch(int level)
+{
+#ifdef CPU_DISPATCH
+    if(level >= CPU_AVX512) return searchAvx512;
+    if(level >= CPU_AVX2) return searchAvx2;
+#endif /* CPU_DISPATCH */
+    (void)level;
+    return searchGeneric;
+}
+
+/* the best one the processor supports, unless --cpu says otherwise */
+static searchFunction *search = searchGeneric;
+
+/* encodes BLOCK_SAMPLES samples of one channel into 36 bytes at out,
+   starting with step index start */
+static void encodeChannel(uint8_t *out, const int32_t *samples,
+        uint32_t start)
+{
+    int32_t predictor = samples[0];
+    uint32_t index = start;
+    *(int16_t *)out = predictor;
+    out[2] = index;
+    out[3] = 0;
+    for(size_t w = 1; w < BLOCK_WORDS; ++w)
+    {
+        /* low nibble is the first sample */
+        uint32_t word = 0;
+        for(size_t n = 0; n < 8; ++n)
+            word |= encodeSample(samples[(w - 1)*8 + n + 1],
+                    &predictor, &index) << 4*n;
+        *(uint32_t *)(out + w*4) = word;
+    }
+}
+
+/* encodes blocks of interleaved 16 bit samples into Wwise IMA ADPCM blocks,
+   clusters of channels one after another,
+   returns sum of differences of decoded samples and samples */
+static uint64_t encodeBlocks(uint8_t *out, const int16_t *in, size_t blocks,
+        size_t channels)
+{
+    uint64_t total = 0;
+    int32_t samples[BLOCK_SAMPLES];
+    for(size_t block = 0; block < blocks; ++block)
+    {
+        for(size_t s = 0; s < channels; ++s)
+        {
+            for(size_t n = 0; n < BLOCK_SAMPLES; ++n)
+                samples[n] = in[n*channels + s];
+            uint32_t error;
+            encodeChannel(out + s*BLOCK_WORDS*4, samples,
+                    search(samples, &error));
+            total += error;
+        }
+        in += BLOCK_SAMPLES*channels;
+        out += BLOCK_WORDS*4*channels;
+    }
+    return total;
+}
+
+
+/* blocks of one file shared by encoding threads */
+struct encodeJob
+{
+    struct batchJob batch;
+    size_t channels;
+    uint64_t frames; /* samples of every channel in the input file */
+};
+
+/* thread function, encodes batches of blocks until there is none left */
+static void *encodeBatches(void *argument)
+{
+    struct encodeJob *job = argument;
+    size_t channels = job->channels,
+           pcmBlock = BLOCK_SAMPLES*channels*2,
+           align = BLOCK_WORDS*4*channels;
+    int16_t *in = malloc(BATCH_BLOCKS*pcmBlock);
+    uint8_t *out = malloc(BATCH_BLOCKS*align);
+    uint8_t failed = in == NULL || out == NULL ? 3 : 0;
+    size_t first, blocks;
+    while((blocks = batchNext(&job->batch, failed, &first)) > 0)
+    {
+        /* NOTE: the last block is filled up with the last sample */
+        uint64_t frames = job->frames - (uint64_t)first*BLOCK_SAMPLES;
+        if(frames > blocks*BLOCK_SAMPLES) frames = blocks*BLOCK_SAMPLES;
+        if(readAt(job->batch.in, in, frames*channels*2,
+                    job->batch.inOffset + (uint64_t)first*pcmBlock) <
+                frames*channels*2)
+        {
+            failed = 1;
+        }
+        else
+        {
+            for(size_t n = frames; n < blocks*BLOCK_SAMPLES; ++n)
+                memcpy(in + n*channels, in + (frames - 1)*channels,
+                        channels*2);
+            encodeBlocks(out, in, blocks, channels);
+            if(writeAt(job->batch.out, out, blocks*align,
+                        job->batch.outOffset + (uint64_t)first*align) <
+                    blocks*align)
+                failed = 2;
+        }
+    }
+    free(in);
+    free(out);
+    return NULL;
+}
+
+/* encodes one 16 bit PCM file into FileName_wwise.wav
+   (without ".wav" of FileName),
+   returns 1 when the program should stop, 2 when the file couldn't be
+   read as far as its header said (the output is removed), 0 otherwise */
+static int encodeFile(const char *fileName)
+{
+    static uint32_t riffMark = string4ToInt32('R','I','F','F');
+    static uint32_t waveMark = string4ToInt32('W','A','V','E');
+    static uint32_t  fmtMark = string4ToInt32('f','m','t',' ');
+    static uint32_t dataMark = string4ToInt32('d','a','t','a');
+    static uint32_t factMark = string4ToInt32('f','a','c','t');
+    FILE *file = fopen(fileName, "rb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "%s: Error opening file.\n", fileName);
+        return 0;
+    }
+    if(setvbuf(file, NULL, _IONBF, 0))
+    {
+        fprintf(stderr, "%s: Error using file?!\n", fileName);
+        fclose(file); return 0;
+    }
+    uint32_t magick[3] = {0,0,0};
+    if(fread(magick, 1, 4*3, file) < 4*3 ||
+            magick[0] != riffMark || magick[2] != waveMark)
+    {
+        fprintf(stderr, "%s: File is not RIFF WAVE file.\n", fileName);
+        fclose(file); return 0;
+    }
+    size_t fmtLength = findChunk(fmtMark, file, fileName);
+    /* PCM is 16 bytes, WAVE_FORMAT_EXTENSIBLE is 40 */
+    uint8_t fmtDescription[40];
+    if(fmtLength < 16 || fmtLength > 40 ||
+            fread(fmtDescription, 1, fmtLength, file) < fmtLength)
+    {
+        fprintf(stderr, "%s: Can't read fmt chunk.\n", fileName);
+        fclose(file); return 0;
+    }
+    uint16_t formatID = *(uint16_t *)fmtDescription,
+             channels = *(uint16_t *)(fmtDescription+2),
+             sampleBits = *(uint16_t *)(fmtDescription+14);
+    uint32_t rate = *(uint32_t *)(fmtDescription+4);
+    /* PCM, or WAVE_FORMAT_EXTENSIBLE with PCM in it */
+    if(formatID == 0xFFFE && fmtLength >= 26)
+        formatID = *(uint16_t *)(fmtDescription+24);
+    if(formatID != 0x0001 || sampleBits != 16)
+    {
+        fprintf(stderr, "%s: File is not 16 bit PCM wave. It has format ID "
+                "0x%04x, bits per sample %u.\n", fileName, formatID,
+                sampleBits);
+        fclose(file); return 0;
+    }
+    /* NOTE: nBlockAlign is 16 bit */
+    if(channels == 0 || channels > 0xffff/(BLOCK_WORDS*4))
+    {
+        fprintf(stderr, "%s: Can't encode %u channels.\n", fileName,
+                (unsigned)channels);
+        fclose(file); return 0;
+    }
+    /* "data" is after "fmt " */
+    size_t dataLength = findChunk(dataMark, file, fileName);
+    int64_t dataPoint = fileTell(file);
+    uint64_t frames = dataLength / (channels*2);
+    /* files cut short are encoded as far as they go */
+    int64_t fileSize = -1;
+    if(dataPoint >= 0 && fileSeek(file, 0, SEEK_END) == 0)
+        fileSize = fileTell(file);
+    if(fileSize >= dataPoint &&
+            (uint64_t)(fileSize - dataPoint)/(channels*2) < frames)
+    {
+        fprintf(stderr, "%s: File is shorter then its data chunk, "
+                "%llu samples of %llu are encoded.\n", fileName,
+                (unsigned long long)(fileSize - dataPoint)/(channels*2),
+                (unsigned long long)frames);
+        frames = (fileSize - dataPoint)/(channels*2);
+    }
+    if(frames == 0 || fileSize < dataPoint)
+    {
+        fprintf(stderr, "%s: File has no usable data...\n", fileName);
+        fclose(file); return 0;
+    }
+    if(frames > (uint32_t)-1)
+    {
+        fprintf(stderr, "%s: Encoded file would be too big for wave file.\n",
+                fileName);
+        fclose(file); return 0;
+    }
+
+    size_t align = BLOCK_WORDS*4*channels,
+           blocks = (frames + BLOCK_SAMPLES - 1) / BLOCK_SAMPLES;
+    uint64_t adpcmSize = (uint64_t)blocks*align;
+    if(adpcmSize > (uint32_t)-1 - 56)
+    {
+        fprintf(stderr, "%s: Encoded file would be too big for wave file.\n",
+                fileName);
+        fclose(file); return 0;
+    }
+    uint32_t adpcmLength = adpcmSize;
+
+    /* name_wwise.wav */
+    size_t nameLength = strlen(fileName);
+    char *outName = malloc(nameLength + 10 + 1);
+    if(outName == NULL)
+    {
+        fprintf(stderr, "Error allocating memory?!\nAborting.\n");
+        fclose(file); return 1;
+    }
+    if(nameLength > 4 && strcmp(fileName + nameLength - 4, ".wav") == 0)
+        nameLength -= 4;
+    sprintf(outName, "%.*s_wwise.wav", (int)nameLength, fileName);
+    FILE *fileWriter = fopen(outName, "w+b");
+    if(fileWriter == NULL || setvbuf(fileWriter, NULL, _IONBF, 0))
+    {
+        fprintf(stderr, "%s: Error creating file.\nAborting.\n", outName);
+        if(fileWriter) fclose(fileWriter);
+        free(outName); fclose(file); return 1;
+    }
+
+    /* Wwise IMA ADPCM wave header, fmt chunk as reformat.c describes it,
+       "fact" chunk has the number of samples, as the last block
+       is filled up */
+    uint8_t header[12 + 8 + 24 + 12 + 8];
+    *(uint32_t *)header = riffMark;
+    *(uint32_t *)(header+4) = 4 + 8 + 24 + 12 + 8 + adpcmLength;
+    *(uint32_t *)(header+8) = waveMark;
+    *(uint32_t *)(header+12) = fmtMark;
+    *(uint32_t *)(header+16) = 24;
+    uint8_t *fmt = header + 20;
+    *(uint16_t *)fmt = 0x0002;
+    *(uint16_t *)(fmt+2) = channels;
+    *(uint32_t *)(fmt+4) = rate;
+    *(uint32_t *)(fmt+8) = (uint64_t)align*rate/BLOCK_SAMPLES;
+    *(uint16_t *)(fmt+12) = align;
+    *(uint16_t *)(fmt+14) = 4;
+    *(uint16_t *)(fmt+16) = 6;
+    *(uint16_t *)(fmt+18) = BLOCK_SAMPLES;
+    /* dwChannelMask of the usual layouts, as WAVE_FORMAT_EXTENSIBLE has it */
+    *(uint32_t *)(fmt+20) = channels == 1 ? 0x4 : channels == 2 ? 0x3 :
+        channels == 4 ? 0x33 : channels == 6 ? 0x3f :
+        channels == 8 ? 0x63f : 0;
+    *(uint32_t *)(header+44) = factMark;
+    *(uint32_t *)(header+48) = 4;
+    *(uint32_t *)(header+52) = frames;
+    *(uint32_t *)(header+56) = dataMark;
+    *(uint32_t *)(header+60) = adpcmLength;
+
+    int result = 0;
+    struct encodeJob job;
+    memset(&job, 0, sizeof(job));
+    job.batch.in = file;
+    job.batch.out = fileWriter;
+    job.batch.inOffset = dataPoint;
+    job.batch.outOffset = sizeof(header);
+    job.batch.blocks = blocks;
+    job.channels = channels;
+    job.frames = frames;
+    if(writeAt(fileWriter, header, sizeof(header), 0) < sizeof(header))
+    {
+        job.batch.failed = 2;
+    }
+    else
+    {
+        batchRun(&job.batch, encodeBatches, &job, optionThreads);
+    }
+    if((fclose(fileWriter) != 0) | (job.batch.failed >= 2))
+    {
+        fprintf(stderr, "%s: Error writing file.\nAborting.\n", outName);
+        result = 1;
+    }
+    else if(job.batch.failed == 1)
+    {
+        /* NOTE: the header doesn't match what is encoded */
+        fprintf(stderr, "%s: Error reading file.\n", fileName);
+        remove(outName);
+        result = 2;
+    }
+    else
+    {
+        fprintf(stdout, "%s\n", outName);
+    }
+    free(outName);
+    fclose(file);
+    return result;
+}
+
+/* measures speed of encoding of samples in memory with every level
+   of vector code the processor supports, 2 channels,
+   checks that results are the same and that decoder gives back
+   exactly what encoder expects, returns 0 when they are right */
+static int benchmark(void)
+{
+    static const size_t blocks = 4096, channels = 2, repeat = 4;
+    size_t frames = blocks*BLOCK_SAMPLES,
+           align = BLOCK_WORDS*4*channels;
+    int16_t *in = malloc(frames*channels*2),
+            *decoded = malloc(frames*channels*2);
+    uint8_t *out = malloc(blocks*align), *check = malloc(blocks*align);
+    if(in == NULL || decoded == NULL || out == NULL || check == NULL)
+    {
+        fprintf(stderr, "Error allocating memory?!\n");
+        free(in); free(decoded); free(out); free(check);
+        return 1;
+    }
+    /* NOTE: triangle waves of different periods with noise,
+       louder and quieter, something like sound */
+    for(size_t n = 0; n < frames; ++n)
+        for(size_t s = 0; s < channels; ++s)
+        {
+            int32_t period = 100 + 37*s, phase = n % period,
+                    triangle = (phase < period/2 ? phase : period - phase)*
+                        (16000/(period/2)) - 8000,
+                    loudness = 1 + (n >> 12) % 4,
+                    noise = (int32_t)((uint32_t)((n*channels + s)*
+                                2654435761u) >> 24) - 128;
+            in[n*channels + s] = triangle*loudness + noise;
+        }
+    struct adpcmFormat format = {channels, align, BLOCK_WORDS, BLOCK_SAMPLES,
+        1};
+    int result = 0;
+    for(int level = 0; level <= cpuDetect(); ++level)
+    {
+        search = pickSearch(level);
+        /* NOTE: levels without their own code are not measured again */
+        if(level && search == pickSearch(level - 1)) continue;
+        uint64_t error = 0;
+        clock_t start = clock();
+        for(size_t r = 0; r < repeat; ++r)
+            error = encodeBlocks(out, in, blocks, channels);
+        double seconds = (double)(clock() - start)/CLOCKS_PER_SEC;
+        if(seconds <= 0) seconds = 1e-9;
+        if(level == 0) memcpy(check, out, blocks*align);
+        /* decoded samples have to be as far from samples
+           as encoder thinks they are */
+        decodeBlocksGeneric(decoded, out, blocks, &format);
+        uint64_t decodedError = 0;
+        for(size_t n = 0; n < frames*channels; ++n)
+            decodedError += abs(decoded[n] - in[n]);
+        uint8_t wrong = memcmp(check, out, blocks*align) != 0 ||
+            decodedError != error;
+        result |= wrong;
+        printf("encode (%s): %.1f MB/s of PCM, %.1f million samples/s, "
+                "one thread, average error %.1f%s\n", cpuNames[level],
+                (double)frames*channels*2*repeat/seconds/1e6,
+                (double)frames*channels*repeat/seconds/1e6,
+                (double)decodedError/(frames*channels),
+                wrong ? ", WRONG RESULT" : "");
+    }
+    free(in); free(decoded); free(out); free(check);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    for(size_t n = 0; n < 89; ++n) stepSizes[n] = stepTable[n];
+    search = pickSearch(cpuDetect());
+    if(argc == 2 && strcmp(argv[1], "--benchmark") == 0)
+    {
+        return benchmark();
+    }
+    size_t i = 1;
+    for(; i < (size_t)argc && argv[i][0] == '-'; ++i)
+    {
+        if(strcmp(argv[i], "--") == 0)
+        {
+            ++i;
+            break;
+        }
+        else if(strcmp(argv[i], "--cpu") == 0 && i + 1 < (size_t)argc)
+        {
+            int level = cpuParse(argv[++i]);
+            if(level < 0) return -1;
+            search = pickSearch(level);
+        }
+        else if(strcmp(argv[i], "-j") == 0 && i + 1 < (size_t)argc)
+        {
+            char *numberEnd;
+            optionThreads = strtoul(argv[++i], &numberEnd, 10);
+            if(*numberEnd != '\0')
+            {
+                fprintf(stderr, "%s: Wrong number of threads.\n", argv[i]);
+                return -1;
+            }
+#ifdef USE_THREADS
+            if(optionThreads == 0) /* as much as there is processors */
+            {
+                long processors = sysconf(_SC_NPROCESSORS_ONLN);
+                optionThreads = processors > 0 ? processors : 1;
+            }
+#else
+            optionThreads = 1; /* not supported */
+#endif /* USE_THREADS */
+        }
+        else
+        {
+            fprintf(stderr, "%s: Unknown option.\n", argv[i]);
+            return -1;
+        }
+    }
+    if(i >= (size_t)argc)
+    {
+        fprintf(stderr, "Usage: %s [-j N] [--cpu LEVEL] [--] FileName1 [FileName2...]\n"
+                "Encodes 16 bit PCM wave files into Wwise IMA ADPCM wave files\n"
+                "FileName_wwise.wav (36 bytes of every channel in a block),\n"
+                "prints names of the encoded files.\n"
+                "  -j  encode blocks of a file with N threads, 0 is for one thread per processor\n"
+                "  --cpu  use vector code of LEVEL: generic, sse2, avx2 or avx512,\n"
+                "      instead of the best one the processor supports (for benchmarks)\n"
+                "%s --benchmark measures speed of encoding with every level.\n"
+                "Version r4\n"
+                , argv[0], argv[0]);
+        return -1;
+    }
+    int result = 0;
+    for(; i < (size_t)argc; ++i)
+    {
+        int status = encodeFile(argv[i]);
+        if(status == 1) return 1;
+        /* NOTE: the rest of the files are encoded anyway */
+        if(status) result = 1;
+    }
+    return result;
+}
@@ -8,11 +8,52 @@ The above copyright notice and this permission notice shall be included in all c
 THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+/* 64 bit offsets of files on 32 bit systems too (see fileio.h) */
+#define _FILE_OFFSET_BITS 64
+
+#ifdef __linux__
+#define _GNU_SOURCE /* copy_file_range */
+#endif /* __linux__ */
+
 #include <stdint.h> /* uint32_t,size_t,uint8_t */
-#include <stdlib.h> /* malloc,free */
+#include <stdlib.h> /* malloc,calloc,realloc,free,strtoul */
 #include <stdio.h> /* fprintf,printf,fopen,setvbuf,fclose,fread,fwrite,ferror,
                       [feof],snprintf */
-#include <string.h> /* strlen */
+#include <string.h> /* strlen,strcmp,memchr,memmove */
+
+#if defined(__unix__) || defined(__APPLE__)
+/* input files are mapped into memory when it is possible */
+#define USE_MMAP 1
+#include <sys/mman.h> /* mmap,munmap,madvise */
+#include <sys/stat.h> /* fstat */
+#include <unistd.h> /* sysconf,link,unlink */
+#include <pthread.h> /* pthread_create,pthread_join,pthread_mutex_* */
+/* duplicates are hard links to the first file (-d) */
+#define USE_LINK 1
+#endif /* __unix__ || __APPLE__ */
+
+#ifdef __linux__
+/* extracted files are copied by the kernel when it is possible */
+#define USE_COPY_RANGE 1
+#include <errno.h> /* errno,EINVAL */
+#include <sys/ioctl.h> /* ioctl */
+#include <linux/fs.h> /* FICLONERANGE,struct file_clone_range */
+#endif /* __linux__ */
+
+#ifdef _WIN32
+/* stdin is switched to binary mode */
+#include <io.h> /* _setmode,_fileno */
+#include <fcntl.h> /* _O_BINARY */
+#endif /* _WIN32 */
+
+#include "wwise.h" /* wwiseFindRiff,wwiseRiffLength,wwiseScanner*,wwiseTransform*,
+                     wwiseCpuLevel,wwiseSetCpuLevel */
+#include "cpu.h" /* cpuParse */
+#include "stats.h" /* struct stats,statsClock,statsAdd,statsJson */
+#include "walk.h" /* struct fileList,fileListAdd,fileListFree,isDirectory,walkTree */
+#include "dedup.h" /* struct hashState,hash*,struct dedupTable,dedup* */
+#include "state.h" /* struct stateTable,struct stateRecord,state* */
+#include "fileio.h" /* readAt,fileSeek,fileTell */
 
 /* size of input/output buffer used by the program */
 /* NOTE: the minimal size of the resulting buffer is 4+3
@@ -58,45 +99,1552 @@ is Undefined Behavior, and can be compiled in unexpected ways
 so, you should probably compile with -fno-strict-aliasing */
 /* NOTE: in this program integers are only unsigned. Neat! */
 
-/* TODO: if input is directory, process all the files inside */
-/* TODO: let the program take input from stdin */
+/* split files at recorded RIFF length when header looks right (-l) */
+static uint8_t optionLength = 0;
+/* write index of input files instead of extracting (-i),
+   print it as CSV (-c) */
+static uint8_t optionIndex = 0, optionCsv = 0;
+/* change Wwise IMA ADPCM files the same way reformat does (-t) */
+static uint8_t optionTransform = 0;
+/* extract only these entries of index (-x) */
+static const char *optionSelect = NULL;
+/* number of threads working on one mapped input file (-j) */
+static size_t optionThreads = 1;
+/* name of the table of hashes of written files (-d) */
+static const char *optionDedup = NULL;
+static struct dedupTable dedupTable;
+/* name of the state of previous runs (-s) */
+static const char *optionState = NULL;
+static struct stateTable stateTable;
+/* files extracted from the current input file, when they are recorded */
+static struct fileList stateOutputs;
+static uint8_t stateRecording = 0;
+/* input files are recognized by their size, time of modification
+   and hash of STATE_SAMPLES pieces of STATE_SAMPLE_SIZE bytes
+   (all of the file when it is small) */
+#define STATE_SAMPLES 16
+#define STATE_SAMPLE_SIZE 4096
+/* smallest part of input file given to a thread */
+#define MIN_THREAD_PART (1 << 20)
+
+/* all extracted files go into one pack file instead (-p), it is written
+   with big sequential writes and no other files are created:
+ * 0  "WPAK"
+ * 4  uint32_t version = 1
+ * 8  extracted files one after another
+ *    index, entry for every file:
+ *    0  uint64_t offset of the file in the pack
+ *    8  uint64_t length of the file
+ *    16 uint32_t length of the name
+ *    20 name of the file as it would be extracted (without '\0')
+ * last PACK_TAIL_SIZE bytes:
+ *    0  uint64_t offset of the index
+ *    8  uint64_t number of entries
+ *    16 "WPAK"
+ *    20 uint32_t version = 1 */
+#define PACK_HEADER_SIZE 8
+#define PACK_ENTRY_SIZE 20
+#define PACK_TAIL_SIZE 24
+#define PACK_VERSION 1
+/* buffer of pack file */
+#define PACK_BUFFER_SIZE (1 << 20)
+
+struct pack
+{
+    FILE *file;
+    const char *fileName;
+    uint64_t position; /* of the next byte written */
+    uint64_t entryStart; /* of the current file */
+    uint8_t *index; /* is written at the end */
+    size_t indexSize, indexCapacity;
+    uint64_t count;
+};
+
+/* name of pack file (-p) */
+static const char *optionPack = NULL;
+static struct pack pack = {NULL, NULL, 0, 0, NULL, 0, 0, 0};
+
+/* prints name of extracted file, records it in the state when asked (-s) */
+static void printOutput(const char *outName)
+{
+    /* NOTE: files in pack are not files, name of the pack is printed
+       at the end instead */
+    if(optionPack) return;
+    fprintf(stdout, "%s\n", outName);
+    /* NOTE: without memory the input file is not recorded,
+       so it is extracted again next time */
+    if(stateRecording && fileListAdd(&stateOutputs, outName, NULL))
+        stateRecording = 0;
+}
+
+/* creates output file named outName, or starts the next file
+   in the pack (-p), returns NULL on error (it is reported) */
+static FILE *createOutput(const char *outName, struct stats *stats)
+{
+    if(optionPack)
+    {
+        pack.entryStart = pack.position;
+        return pack.file;
+    }
+    ++stats->otherCalls;
+    FILE *fileWriter = fopen(outName, "wb");
+    if(fileWriter == NULL)
+    {
+        fprintf(stderr, "%s: Error creating file.\nAborting.\n", outName);
+    }
+    return fileWriter;
+}
+
+/* writes to output file, returns what fwrite() returns */
+static size_t writeOutput(FILE *fileWriter, const void *data, size_t size)
+{
+    size_t ioStatus = fwrite(data, size, 1, fileWriter);
+    if(fileWriter == pack.file) pack.position += ioStatus*size;
+    return ioStatus;
+}
+
+/* closes output file after error, pack is left as it is */
+static void closeOutput(FILE *fileWriter)
+{
+    if(fileWriter != pack.file) fclose(fileWriter);
+}
+
+/* adds the current file of the pack to its index, returns 0 on success */
+static int packAdd(const char *outName)
+{
+    size_t nameLength = strlen(outName);
+    if(pack.indexSize + PACK_ENTRY_SIZE + nameLength > pack.indexCapacity)
+    {
+        size_t capacity = pack.indexCapacity ? pack.indexCapacity*2 : 65536;
+        while(pack.indexSize + PACK_ENTRY_SIZE + nameLength > capacity)
+            capacity *= 2;
+        uint8_t *index = realloc(pack.index, capacity);
+        if(index == NULL) return 1;
+        pack.index = index;
+        pack.indexCapacity = capacity;
+    }
+    uint8_t *entry = pack.index + pack.indexSize;
+    *(uint64_t *)entry = pack.entryStart;
+    *(uint64_t *)(entry+8) = pack.position - pack.entryStart;
+    *(uint32_t *)(entry+16) = nameLength;
+    memcpy(entry + PACK_ENTRY_SIZE, outName, nameLength);
+    pack.indexSize += PACK_ENTRY_SIZE + nameLength;
+    ++pack.count;
+    return 0;
+}
+
+/* checks for errors and closes output file (or adds it to the pack),
+   returns 0 on success */
+static int finishFile(FILE *fileWriter, const char *outName,
+        struct stats *stats)
+{
+    if(fileWriter == pack.file)
+    {
+        if(ferror(fileWriter))
+        {
+            fprintf(stderr, "%s: Error writing to a file.\nAborting.\n",
+                    pack.fileName);
+            return 1;
+        }
+        if(packAdd(outName))
+        {
+            fprintf(stderr, "Error allocating memory?!\nAborting.\n");
+            return 1;
+        }
+        return 0;
+    }
+    ++stats->otherCalls;
+    /* try to close the file in any case */
+    if(ferror(fileWriter) | fclose(fileWriter))
+    {
+        fprintf(stderr, "%s: Error writing to a file.\nAborting.\n", outName);
+        return 1;
+    }
+    return 0;
+}
+
+#ifdef USE_COPY_RANGE
+/* 0 when kernel refused to clone or copy files once, no need to ask again,
+   -j writer threads share them, so they are read and written
+   with __atomic builtins (this is Linux only code, GCC or clang) */
+static uint8_t cloneWorks = 1, copyWorks = 1;
+
+/* copies length bytes at offset of input file to the current position
+   of output file without reading them into memory,
+   returns how much bytes were copied, the rest has to be written as usual */
+static uint64_t copyRange(int outFd, int inFd, uint64_t offset,
+        uint64_t length, struct stats *stats)
+{
+    /* NOTE: clone (reflink) shares blocks of the file between files
+       on btrfs/XFS, but the range has to be aligned to file system blocks,
+       most extracted files are not */
+    if(__atomic_load_n(&cloneWorks, __ATOMIC_RELAXED) && offset % 4096 == 0)
+    {
+        struct file_clone_range range = {inFd, offset, length, 0};
+        ++stats->writeCalls;
+        if(ioctl(outFd, FICLONERANGE, &range) == 0)
+        {
+            ++stats->otherCalls;
+            if(lseek(outFd, length, SEEK_SET) == (off_t)length) return length;
+            return 0;
+        }
+        if(errno != EINVAL) __atomic_store_n(&cloneWorks, 0, __ATOMIC_RELAXED);
+    }
+    uint64_t copied = 0;
+    loff_t inOffset = offset;
+    while(__atomic_load_n(&copyWorks, __ATOMIC_RELAXED) && copied < length)
+    {
+        /* NOTE: size_t is 32 bit on 32 bit systems */
+        size_t amount = length - copied < (1 << 30) ?
+            length - copied : (1 << 30);
+        ssize_t ioStatus = copy_file_range(inFd, &inOffset, outFd, NULL,
+                amount, 0);
+        ++stats->writeCalls;
+        if(ioStatus <= 0)
+        {
+            /* NOTE: real errors happen again with fwrite() and are
+               reported there, here it just falls back to usual way */
+            if(ioStatus < 0 && errno != EINTR && errno != EIO &&
+                    errno != ENOSPC)
+                __atomic_store_n(&copyWorks, 0, __ATOMIC_RELAXED);
+            break;
+        }
+        copied += ioStatus;
+    }
+    return copied;
+}
+#endif /* USE_COPY_RANGE */
+
+#ifdef USE_LINK
+/* makes outName a hard link to the file with the same hash and length
+   written before (now or by previous runs with the same table, -d),
+   returns 1 when it is done, 0 otherwise */
+/* NOTE: files are never overwritten with -d, they are replaced,
+   otherwise all the files linked to them would change too */
+static int linkDuplicate(const char *outName, uint64_t hash, uint64_t length,
+        struct stats *stats)
+{
+    char *path = dedupFind(&dedupTable, hash, length, optionTransform,
+            outName);
+    int linked = 0;
+    struct stat pathStat, outStat;
+    ++stats->otherCalls;
+    if(path && stat(path, &pathStat) == 0 &&
+            (uint64_t)pathStat.st_size == length)
+    {
+        ++stats->otherCalls;
+        if(stat(outName, &outStat) == 0 && outStat.st_dev == pathStat.st_dev &&
+                outStat.st_ino == pathStat.st_ino)
+        {
+            linked = 1; /* it is already there */
+        }
+        else
+        {
+            /* link with temporary name replaces outName at once */
+            size_t outNameLength = strlen(outName);
+            char *tempName = malloc(outNameLength + 2);
+            if(tempName)
+            {
+                memcpy(tempName, outName, outNameLength);
+                memcpy(tempName + outNameLength, "~", 2);
+                unlink(tempName);
+                linked = link(path, tempName) == 0;
+                if(linked && rename(tempName, outName))
+                {
+                    unlink(tempName);
+                    linked = 0;
+                }
+                stats->otherCalls += 3;
+                free(tempName);
+            }
+        }
+    }
+    if(linked)
+    {
+        ++stats->filesLinked;
+        stats->bytesLinked += length;
+    }
+    else
+    {
+        /* file was removed or it is on another file system,
+           duplicates are linked to this one from now on */
+        if(path) dedupReplace(&dedupTable, hash, length, optionTransform,
+                outName);
+    }
+    free(path);
+    return linked;
+}
+#else
+static int linkDuplicate(const char *outName, uint64_t hash, uint64_t length,
+        struct stats *stats)
+{
+    (void)outName; (void)hash; (void)length; (void)stats;
+    return 0; /* not supported */
+}
+#endif /* USE_LINK */
+
+/* writes [begin, end) into the new file named outName,
+   begin is at offset of input file inFd (or inFd is -1),
+   returns 0 on success */
+static int writeWhole(const char *outName, const uint8_t *begin,
+        const uint8_t *end, int inFd, uint64_t offset, struct stats *stats)
+{
+    uint64_t startTime = statsClock();
+    FILE *fileWriter = createOutput(outName, stats);
+    if(fileWriter == NULL) return 1;
+    stats->bytesWritten += end - begin;
+#ifdef USE_COPY_RANGE
+    /* NOTE: pack is written through its buffer */
+    if(inFd >= 0 && end > begin && !optionPack)
+    {
+        begin += copyRange(fileno(fileWriter), inFd, offset, end - begin,
+                stats);
+    }
+#else
+    (void)inFd; (void)offset;
+#endif /* USE_COPY_RANGE */
+    if(end > begin)
+    {
+        /* error is checked by finishFile() */
+        writeOutput(fileWriter, begin, end - begin);
+        ++stats->writeCalls;
+    }
+    int result = finishFile(fileWriter, outName, stats);
+    stats->writeTime += statsClock() - startTime;
+    return result;
+}
+
+/* where wwiseTransform puts changed file */
+struct transformOutput
+{
+    FILE *fileWriter;
+    struct stats *stats;
+    uint64_t writeTime;
+};
+
+/* wwiseDataFunction, returns 1 on error, which is checked by finishFile() */
+static int writeTransformedPart(void *user, const uint8_t *data, size_t size)
+{
+    struct transformOutput *output = user;
+    uint64_t startTime = statsClock();
+    size_t ioStatus = writeOutput(output->fileWriter, data, size);
+    output->writeTime += statsClock() - startTime;
+    ++output->stats->writeCalls;
+    output->stats->bytesWritten += size;
+    return ioStatus == 0;
+}
+
+/* writes RIFF file [start, stop) into the new file named outName
+   changed the same way reformat would change it,
+   returns 0 on success */
+static int writeTransformed(const char *outName, const uint8_t *start,
+        const uint8_t *stop, struct stats *stats)
+{
+    uint64_t startTime = statsClock();
+    FILE *fileWriter = createOutput(outName, stats);
+    if(fileWriter == NULL) return 1;
+    /* NOTE: it is too big for the stack of some threads */
+    struct wwiseTransform *transform = malloc(sizeof(*transform));
+    if(transform == NULL)
+    {
+        fprintf(stderr, "Error allocating memory?!\nAborting.\n");
+        closeOutput(fileWriter);
+        return 1;
+    }
+    struct transformOutput output = {fileWriter, stats, 0};
+    wwiseTransformInit(transform, writeTransformedPart, &output);
+    /* NOTE: errors are checked by finishFile() */
+    if(wwiseTransformFeed(transform, start, stop - start) == 0)
+        wwiseTransformFinish(transform);
+    free(transform);
+    uint64_t transformTime = statsClock() - startTime - output.writeTime;
+    int result = finishFile(fileWriter, outName, stats);
+    stats->transformTime += transformTime;
+    stats->writeTime += statsClock() - startTime - transformTime;
+    return result;
+}
+
+/* writes [start, stop) at offset of input file inFd into the new file
+   named outName, changed the way reformat does it when asked (-t),
+   returns 0 on success */
+static int writeEntry(const char *outName, const uint8_t *start,
+        const uint8_t *stop, int inFd, uint64_t offset, struct stats *stats)
+{
+    ++stats->filesFound;
+    if(optionDedup)
+    {
+        uint64_t startTime = statsClock(),
+                 hash = hashBytes(start, stop - start);
+        stats->scanTime += statsClock() - startTime;
+        if(linkDuplicate(outName, hash, stop - start, stats)) return 0;
+#ifdef USE_LINK
+        unlink(outName);
+        ++stats->otherCalls;
+#endif /* USE_LINK */
+    }
+    if(optionTransform)
+    {
+        return writeTransformed(outName, start, stop, stats);
+    }
+    return writeWhole(outName, start, stop, inFd, offset, stats);
+}
+
+/* index of input file (-i) is written to "name.idx" instead of extracting:
+ * 0  "WIDX"
+ * 4  uint32_t version = 1
+ * 8  uint64_t size of input file
+ * 16 uint64_t number of entries
+ * 24 entries, INDEX_ENTRY_SIZE bytes each:
+ *    0  uint64_t offset of extracted file in input file
+ *    8  uint64_t length of extracted file
+ *    16 uint16_t wFormatTag, 0 when there is no "fmt " chunk
+ *    18 uint16_t nChannels
+ *    20 uint32_t nSamplesPerSec
+ *    24 uint16_t nBlockAlign
+ *    26 uint16_t wBitsPerSample
+ *    28 uint32_t flags */
+#define INDEX_HEADER_SIZE 24
+#define INDEX_ENTRY_SIZE 32
+#define INDEX_VERSION 1
+/* flags: length is recorded RIFF length, not the distance to the next "RIFF" */
+#define INDEX_EXACT 1
+
+struct index
+{
+    FILE *file;
+    const char *fileName; /* of input file */
+    char *name; /* of index file */
+    char *tempName; /* written until it is complete, then renamed */
+    uint64_t count;
+};
+
+/* creates index file for input file of the given size,
+   returns 0 on success */
+static int indexBegin(struct index *index, const char *fileName, uint64_t size)
+{
+    static uint32_t indexMark = string4ToInt32('W','I','D','X');
+    index->file = NULL;
+    index->fileName = fileName;
+    index->count = 0;
+    /* NOTE: index is written with temporary name, so interrupted -i
+       leaves the old index (or none), not the one with no entries */
+    size_t nameSize = strlen(fileName) + 4 + 1;
+    index->name = malloc(nameSize*2 + 1);
+    if(index->name == NULL)
+    {
+        fprintf(stderr, "Error allocating memory?!\nAborting.\n");
+        return 1;
+    }
+    index->tempName = index->name + nameSize;
+    sprintf(index->name, "%s.idx", fileName);
+    sprintf(index->tempName, "%s.idx~", fileName);
+    index->file = fopen(index->tempName, "wb");
+    if(index->file == NULL)
+    {
+        fprintf(stderr, "%s: Error creating file.\nAborting.\n",
+                index->tempName);
+        free(index->name);
+        return 1;
+    }
+    uint8_t header[INDEX_HEADER_SIZE];
+    *(uint32_t *)header = indexMark;
+    *(uint32_t *)(header+4) = INDEX_VERSION;
+    *(uint64_t *)(header+8) = size;
+    *(uint64_t *)(header+16) = 0; /* written by indexEnd() */
+    fwrite(header, INDEX_HEADER_SIZE, 1, index->file);
+    if(optionCsv)
+    {
+        static uint8_t csvHeader = 0;
+        if(!csvHeader)
+        {
+            fprintf(stdout, "file,entry,offset,length,format,channels,"
+                    "rate,align,bits,exact\n");
+            csvHeader = 1;
+        }
+    }
+    return 0;
+}
+
+/* adds extracted file [start, stop) at offset of input file to the index,
+   errors are checked by indexEnd() */
+static void indexAdd(struct index *index, const uint8_t *start,
+        const uint8_t *stop, uint64_t offset, uint8_t exact)
+{
+    static uint32_t waveMark = string4ToInt32('W','A','V','E');
+    static uint32_t  fmtMark = string4ToInt32('f','m','t',' ');
+    uint8_t entry[INDEX_ENTRY_SIZE] = {0};
+    *(uint64_t *)entry = offset;
+    *(uint64_t *)(entry+8) = stop - start;
+    /* fmt chunk is taken only when it is the first one, as in Wwise files */
+    if(stop - start >= WWISE_HEADER_SIZE &&
+            *(uint32_t *)(start+8) == waveMark &&
+            *(uint32_t *)(start+12) == fmtMark)
+    {
+        const uint8_t *fmt = start + 20;
+        *(uint16_t *)(entry+16) = *(uint16_t *)fmt;
+        *(uint16_t *)(entry+18) = *(uint16_t *)(fmt+2);
+        *(uint32_t *)(entry+20) = *(uint32_t *)(fmt+4);
+        *(uint16_t *)(entry+24) = *(uint16_t *)(fmt+12);
+        *(uint16_t *)(entry+26) = *(uint16_t *)(fmt+14);
+    }
+    *(uint32_t *)(entry+28) = exact ? INDEX_EXACT : 0;
+    fwrite(entry, INDEX_ENTRY_SIZE, 1, index->file);
+    if(optionCsv)
+    {
+        fprintf(stdout, "\"%s\",%llu,%llu,%llu,%u,%u,%u,%u,%u,%u\n",
+                index->fileName, (unsigned long long)index->count,
+                (unsigned long long)offset,
+                (unsigned long long)(stop - start),
+                *(uint16_t *)(entry+16), *(uint16_t *)(entry+18),
+                *(uint32_t *)(entry+20), *(uint16_t *)(entry+24),
+                *(uint16_t *)(entry+26), exact);
+    }
+    ++index->count;
+}
+
+/* writes number of entries, closes index file and gives it its name,
+   index of extraction that failed is removed, returns 0 on success */
+static int indexEnd(struct index *index, int failed)
+{
+    uint64_t count = index->count;
+    if(fseek(index->file, 16, SEEK_SET) == 0)
+    {
+        fwrite(&count, 8, 1, index->file);
+    }
+    struct stats stats = {0};
+    int result = finishFile(index->file, index->tempName, &stats) | failed;
+    if(!result && rename(index->tempName, index->name))
+    {
+        fprintf(stderr, "%s: Error renaming file.\nAborting.\n",
+                index->tempName);
+        result = 1;
+    }
+    if(result) remove(index->tempName);
+    if(!result && !optionCsv) fprintf(stdout, "%s\n", index->name);
+    free(index->name);
+    return result;
+}
+
+/* returns 1 when list of entries (-x) is like "0,2,5-9":
+   numbers and ranges with the first number not bigger then the last one,
+   separated by commas */
+static uint8_t isList(const char *list)
+{
+    do
+    {
+        char *numberEnd;
+        if(*list < '0' || *list > '9') return 0;
+        uint64_t first = strtoull(list, &numberEnd, 10);
+        if(*numberEnd == '-')
+        {
+            list = numberEnd + 1;
+            if(*list < '0' || *list > '9') return 0;
+            if(strtoull(list, &numberEnd, 10) < first) return 0;
+        }
+        if(*numberEnd != ',' && *numberEnd != '\0') return 0;
+        list = numberEnd;
+    } while(*list++ == ',');
+    return 1;
+}
+
+/* checks whether n-th entry is in the list of entries (-x),
+   list is like "0,2,5-9" (checked by isList()) */
+static uint8_t isSelected(const char *list, uint64_t n)
+{
+    while(*list)
+    {
+        char *numberEnd;
+        uint64_t first = strtoull(list, &numberEnd, 10), last = first;
+        if(*numberEnd == '-')
+        {
+            last = strtoull(numberEnd + 1, &numberEnd, 10);
+        }
+        if(first <= n && n <= last) return 1;
+        list = *numberEnd == ',' ? numberEnd + 1 : numberEnd;
+        if(*numberEnd != ',' && *numberEnd != '\0') break;
+    }
+    return 0;
+}
+
+/* returns the biggest entry number in the list of entries (-x),
+   list is like "0,2,5-9" (checked by isList()) */
+static uint64_t lastSelected(const char *list)
+{
+    uint64_t last = 0;
+    while(*list)
+    {
+        char *numberEnd;
+        uint64_t n = strtoull(list, &numberEnd, 10);
+        if(*numberEnd == '-') n = strtoull(numberEnd + 1, &numberEnd, 10);
+        if(n > last) last = n;
+        if(*numberEnd != ',') break;
+        list = numberEnd + 1;
+    }
+    return last;
+}
+
+/* writes length bytes at offset of input file into the new file
+   named outName, changed the way reformat does it when asked (-t),
+   returns 0 on success */
+static int writeFromFile(const char *outName, FILE *file,
+        uint64_t offset, uint64_t length, struct stats *stats)
+{
+    static uint8_t copyBuffer[BUFFER_SIZE];
+    static struct wwiseTransform transform;
+    uint64_t startTime = statsClock(), readTime = 0;
+    FILE *fileWriter = createOutput(outName, stats);
+    if(fileWriter == NULL) return 1;
+    struct transformOutput output = {fileWriter, stats, 0};
+    if(optionTransform)
+        wwiseTransformInit(&transform, writeTransformedPart, &output);
+    uint64_t done = 0;
+    int failed = 0;
+#ifdef USE_COPY_RANGE
+    if(!optionPack && !optionTransform)
+        done = copyRange(fileno(fileWriter), fileno(file), offset, length,
+                stats);
+#endif /* USE_COPY_RANGE */
+    /* NOTE: copied by the kernel, but read anyway */
+    stats->bytesScanned += done;
+    stats->bytesWritten += done;
+    while(done < length)
+    {
+        size_t amount = length - done < BUFFER_SIZE ?
+            length - done : BUFFER_SIZE;
+        uint64_t readStart = statsClock();
+        size_t ioStatus = readAt(file, copyBuffer, amount, offset + done);
+        readTime += statsClock() - readStart;
+        ++stats->readCalls;
+        stats->bytesScanned += ioStatus;
+        if(ioStatus == 0) break; /* input is shorter then index claims */
+        done += ioStatus;
+        if(optionTransform)
+        {
+            /* NOTE: errors are checked by finishFile() */
+            failed = wwiseTransformFeed(&transform, copyBuffer, ioStatus);
+            if(failed) break;
+            continue;
+        }
+        ++stats->writeCalls;
+        if(writeOutput(fileWriter, copyBuffer, ioStatus) == 0) break;
+        stats->bytesWritten += ioStatus;
+    }
+    uint64_t transformTime = 0;
+    if(optionTransform)
+    {
+        if(!failed) wwiseTransformFinish(&transform);
+        transformTime = statsClock() - startTime - readTime - output.writeTime;
+    }
+    int result = finishFile(fileWriter, outName, stats);
+    stats->readTime += readTime;
+    stats->transformTime += transformTime;
+    stats->writeTime += statsClock() - startTime - readTime - transformTime;
+    return result;
+}
+
+/* creates pack file (-p), returns 0 on success */
+static int packBegin(const char *fileName)
+{
+    static uint32_t packMark = string4ToInt32('W','P','A','K');
+    pack.fileName = fileName;
+    pack.file = fopen(fileName, "wb");
+    if(pack.file == NULL)
+    {
+        fprintf(stderr, "%s: Error creating file.\n", fileName);
+        return 1;
+    }
+    /* NOTE: files are written through big buffer, big ones go
+       straight to the file */
+    setvbuf(pack.file, NULL, _IOFBF, PACK_BUFFER_SIZE);
+    uint32_t header[2] = {packMark, PACK_VERSION};
+    writeOutput(pack.file, header, PACK_HEADER_SIZE);
+    return 0;
+}
+
+/* writes index of the pack and closes it, prints its name,
+   returns 0 on success */
+static int packEnd(void)
+{
+    static uint32_t packMark = string4ToInt32('W','P','A','K');
+    uint8_t tail[PACK_TAIL_SIZE];
+    *(uint64_t *)tail = pack.position;
+    *(uint64_t *)(tail+8) = pack.count;
+    *(uint32_t *)(tail+16) = packMark;
+    *(uint32_t *)(tail+20) = PACK_VERSION;
+    if(pack.indexSize) fwrite(pack.index, pack.indexSize, 1, pack.file);
+    fwrite(tail, PACK_TAIL_SIZE, 1, pack.file);
+    free(pack.index);
+    if(ferror(pack.file) | fclose(pack.file))
+    {
+        fprintf(stderr, "%s: Error writing to a file.\n", pack.fileName);
+        return 1;
+    }
+    fprintf(stdout, "%s\n", pack.fileName);
+    return 0;
+}
+
+/* reads index of the pack file, returns it (to be freed)
+   with its size, its offset (the end of files) and number of entries,
+   NULL when file is not a pack */
+static uint8_t *packRead(FILE *file, size_t *indexSize, uint64_t *indexOffset,
+        uint64_t *count, struct stats *stats)
+{
+    static uint32_t packMark = string4ToInt32('W','P','A','K');
+    uint8_t tail[PACK_TAIL_SIZE];
+    int64_t size = -1;
+    stats->otherCalls += 2;
+    if(fileSeek(file, 0, SEEK_END) == 0) size = fileTell(file);
+    if(size < PACK_HEADER_SIZE + PACK_TAIL_SIZE ||
+            readAt(file, tail, PACK_TAIL_SIZE, size - PACK_TAIL_SIZE) <
+            PACK_TAIL_SIZE ||
+            *(uint32_t *)(tail+16) != packMark ||
+            *(uint32_t *)(tail+20) != PACK_VERSION)
+        return NULL;
+    ++stats->readCalls;
+    uint64_t offset = *(uint64_t *)tail;
+    if(offset < PACK_HEADER_SIZE ||
+            offset > (uint64_t)size - PACK_TAIL_SIZE ||
+            (uint64_t)size - PACK_TAIL_SIZE - offset >= (size_t)-1)
+        return NULL;
+    *indexSize = size - PACK_TAIL_SIZE - offset;
+    *indexOffset = offset;
+    *count = *(uint64_t *)(tail+8);
+    uint8_t *index = malloc(*indexSize + 1);
+    ++stats->readCalls;
+    if(index == NULL || readAt(file, index, *indexSize, offset) != *indexSize)
+    {
+        free(index);
+        return NULL;
+    }
+    return index;
+}
+
+/* returns the last part of the name of a file in the pack
+   (after the last '/', '\\' or ':'), NULL when there is no name there */
+static const char *packedName(const char *name)
+{
+    for(const char *p = name; *p; ++p)
+    {
+        if(*p == '/' || *p == '\\' || *p == ':') name = p + 1;
+    }
+    if(*name == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        return NULL;
+    return name;
+}
+
+/* prints files of the pack as CSV (-c) or extracts files selected
+   by optionSelect (-x) into the current directory by the names
+   they have in the pack (without directories),
+   files are in [PACK_HEADER_SIZE, indexOffset) of the pack,
+   returns 0 on success */
+static int extractPacked(const char *fileName, FILE *file,
+        const uint8_t *index, size_t indexSize, uint64_t indexOffset,
+        uint64_t count, struct stats *stats)
+{
+    if(optionCsv && !optionSelect)
+        fprintf(stdout, "pack,entry,offset,length,name\n");
+    const uint8_t *entry = index, *end = index + indexSize;
+    int result = 0;
+    for(uint64_t n = 0; n < count && !result; ++n)
+    {
+        if(end - entry < PACK_ENTRY_SIZE ||
+                (size_t)(end - entry - PACK_ENTRY_SIZE) <
+                *(uint32_t *)(entry+16))
+        {
+            fprintf(stderr, "%s: Index of the pack is broken.\n", fileName);
+            break;
+        }
+        uint64_t offset = *(uint64_t *)entry,
+                 length = *(uint64_t *)(entry+8);
+        if(offset < PACK_HEADER_SIZE || offset > indexOffset ||
+                length > indexOffset - offset)
+        {
+            fprintf(stderr, "%s: Index of the pack is broken.\n", fileName);
+            break;
+        }
+        uint32_t nameLength = *(uint32_t *)(entry+16);
+        char *name = malloc(nameLength + 1);
+        if(name == NULL)
+        {
+            fprintf(stderr, "Error allocating memory?!\nAborting.\n");
+            return 1;
+        }
+        memcpy(name, entry + PACK_ENTRY_SIZE, nameLength);
+        name[nameLength] = '\0';
+        entry += PACK_ENTRY_SIZE + nameLength;
+        if(optionSelect == NULL)
+        {
+            fprintf(stdout, "\"%s\",%llu,%llu,%llu,\"%s\"\n", fileName,
+                    (unsigned long long)n, (unsigned long long)offset,
+                    (unsigned long long)length, name);
+        }
+        else if(isSelected(optionSelect, n))
+        {
+            /* NOTE: names in the pack are not trusted to point
+               outside of the current directory */
+            const char *outName = packedName(name);
+            if(outName == NULL)
+            {
+                fprintf(stderr, "%s: Entry %llu has no name.\n", fileName,
+                        (unsigned long long)n);
+            }
+            else
+            {
+                ++stats->filesFound;
+                result = writeFromFile(outName, file, offset, length, stats);
+                if(!result) printOutput(outName);
+            }
+        }
+        free(name);
+    }
+    return result;
+}
+
+/* extracts only entries of "name.idx" selected by optionSelect,
+   input file is not searched at all, returns 0 on success */
+static int extractSelected(const char *fileName, FILE *file,
+        char *outName, size_t outNameLength, struct stats *stats)
+{
+    static uint32_t indexMark = string4ToInt32('W','I','D','X');
+    snprintf(outName, outNameLength, "%s.idx", fileName);
+    FILE *indexFile = fopen(outName, "rb");
+    if(indexFile == NULL)
+    {
+        fprintf(stderr, "%s: Error opening file.\n", outName);
+        return 0; /* next input file might have index */
+    }
+    uint8_t header[INDEX_HEADER_SIZE];
+    int64_t size = -1;
+    if(fileSeek(file, 0, SEEK_END) == 0) size = fileTell(file);
+    if(fread(header, INDEX_HEADER_SIZE, 1, indexFile) == 0 ||
+            *(uint32_t *)header != indexMark ||
+            *(uint32_t *)(header+4) != INDEX_VERSION)
+    {
+        fprintf(stderr, "%s: Wrong format of index.\n", outName);
+        fclose(indexFile);
+        return 0;
+    }
+    if(size < 0 || *(uint64_t *)(header+8) != (uint64_t)size)
+    {
+        fprintf(stderr, "%s: Index doesn't match size of %s.\n",
+                outName, fileName);
+        fclose(indexFile);
+        return 0;
+    }
+    uint64_t count = *(uint64_t *)(header+16);
+    int64_t indexSize = -1;
+    if(fileSeek(indexFile, 0, SEEK_END) == 0) indexSize = fileTell(indexFile);
+    if(count > (uint64_t)(INT64_MAX - INDEX_HEADER_SIZE)/INDEX_ENTRY_SIZE ||
+            indexSize != (int64_t)(INDEX_HEADER_SIZE + count*INDEX_ENTRY_SIZE) ||
+            fileSeek(indexFile, INDEX_HEADER_SIZE, SEEK_SET))
+    {
+        fprintf(stderr, "%s: Index is broken.\n", outName);
+        fclose(indexFile);
+        return 0;
+    }
+    uint64_t last = lastSelected(optionSelect);
+    if(last >= count)
+    {
+        fprintf(stderr, "%s.idx: Index has %llu entries, "
+                "entries from %llu to %llu are not there.\n", fileName,
+                (unsigned long long)count,
+                (unsigned long long)count, (unsigned long long)last);
+    }
+    int result = 0;
+    for(uint64_t n = 0; n < count; ++n)
+    {
+        uint8_t entry[INDEX_ENTRY_SIZE];
+        if(fread(entry, INDEX_ENTRY_SIZE, 1, indexFile) == 0)
+        {
+            fprintf(stderr, "%s.idx: Error reading file.\n", fileName);
+            break;
+        }
+        if(!isSelected(optionSelect, n)) continue;
+        uint64_t offset = *(uint64_t *)entry,
+                 length = *(uint64_t *)(entry+8);
+        snprintf(outName, outNameLength,
+                "%s_%08llx.wav", fileName, (unsigned long long)offset);
+        ++stats->filesFound;
+        result = writeFromFile(outName, file, offset, length, stats);
+        if(result) break;
+        printOutput(outName);
+    }
+    fclose(indexFile);
+    return result;
+}
+
+#ifdef USE_MMAP
+/* "RIFF" marks found in a part of mapped input by one thread */
+struct riffList
+{
+    const uint8_t *begin, *end; /* part of the input to search */
+    const uint8_t *limit; /* end of the whole input */
+    const uint8_t **marks;
+    size_t count, capacity;
+    uint64_t scanTime; /* --stats */
+    uint8_t failed;
+};
+
+/* thread function, fills riffList */
+static void *findAllRiff(void *argument)
+{
+    struct riffList *list = argument;
+    /* NOTE: like 3 bytes rollback in extractStream() of old,
+       "RIFF" that starts in the last 3 bytes of the part
+       belongs to this part and is checked with bytes of the next part */
+    const uint8_t *stop = list->limit - list->end > 3 ?
+        list->end + 3 : list->limit;
+    uint64_t startTime = statsClock();
+    for(const uint8_t *p = wwiseFindRiff(list->begin, stop); p != stop;
+            p = wwiseFindRiff(p + 4, stop))
+    {
+        if(list->count == list->capacity)
+        {
+            size_t capacity = list->capacity ? list->capacity*2 : 256;
+            const uint8_t **marks = realloc(list->marks,
+                    capacity*sizeof(*marks));
+            if(marks == NULL)
+            {
+                list->failed = 1;
+                break;
+            }
+            list->marks = marks;
+            list->capacity = capacity;
+        }
+        list->marks[list->count++] = p;
+    }
+    list->scanTime = statsClock() - startTime;
+    return NULL;
+}
+
+/* file to extract, the result of merge of riffLists */
+struct entry
+{
+    const uint8_t *start, *stop;
+    uint8_t exact; /* stop is at recorded RIFF length */
+    uint8_t written;
+};
+
+/* entries shared by writing threads */
+struct entryQueue
+{
+    const char *fileName;
+    const uint8_t *data;
+    int fd;
+    struct entry *entries;
+    size_t count, next;
+    uint8_t failed;
+    struct stats stats; /* of all threads */
+    pthread_mutex_t lock;
+};
+
+/* thread function, writes entries from entryQueue until there is none */
+static void *writeEntries(void *argument)
+{
+    struct entryQueue *queue = argument;
+    struct stats stats = {0};
+    /* name_%08x.wav */
+    size_t outNameLength = strlen(queue->fileName) + 5 + 16 + 1;
+    char *outName = malloc(outNameLength);
+    if(outName == NULL)
+    {
+        fprintf(stderr, "Error allocating memory?!\nAborting.\n");
+    }
+    while(1)
+    {
+        pthread_mutex_lock(&queue->lock);
+        size_t n = queue->next++;
+        if(outName == NULL) queue->failed = 1;
+        uint8_t stop = queue->failed || n >= queue->count;
+        pthread_mutex_unlock(&queue->lock);
+        if(stop) break;
+
+        struct entry *entry = queue->entries + n;
+        snprintf(outName, outNameLength, "%s_%08llx.wav", queue->fileName,
+                (unsigned long long)(entry->start - queue->data));
+        entry->written = !writeEntry(outName, entry->start, entry->stop,
+                queue->fd, entry->start - queue->data, &stats);
+        if(!entry->written)
+        {
+            pthread_mutex_lock(&queue->lock);
+            queue->failed = 1;
+            pthread_mutex_unlock(&queue->lock);
+        }
+    }
+    free(outName);
+    pthread_mutex_lock(&queue->lock);
+    statsAdd(&queue->stats, &stats);
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+/* same as extractMemory(), but input is split into optionThreads parts
+   that are searched in parallel, then files are written in parallel,
+   names of the files are printed in the same order as usual,
+   with index files are added to index instead,
+   returns 0 on success */
+static int extractMemoryThreaded(const char *fileName, int fd,
+        const uint8_t *data, size_t size, char *outName, size_t outNameLength,
+        struct index *index, struct stats *stats)
+{
+    const uint8_t *end = data + size;
+    size_t threads = optionThreads;
+    /* NOTE: there is no point in threads for small files */
+    if(threads > size/MIN_THREAD_PART + 1) threads = size/MIN_THREAD_PART + 1;
+    int result = 1;
+    pthread_t *thread = malloc(threads*sizeof(*thread));
+    struct riffList *lists = calloc(threads, sizeof(*lists));
+    struct entryQueue queue = {fileName, data, fd, NULL, 0, 0, 0, {0},
+        PTHREAD_MUTEX_INITIALIZER};
+    size_t started = 0, total = 0;
+    if(thread == NULL || lists == NULL) goto memoryError;
+
+    /* search */
+    for(size_t t = 0; t < threads; ++t)
+    {
+        lists[t].begin = data + size/threads*t;
+        lists[t].end = t + 1 == threads ? end : data + size/threads*(t + 1);
+        lists[t].limit = end;
+    }
+    for(; started < threads; ++started)
+    {
+        if(pthread_create(thread + started, NULL, findAllRiff, lists + started))
+            break;
+    }
+    /* whatever is not started is done by this thread */
+    for(size_t t = started; t < threads; ++t) findAllRiff(lists + t);
+    for(size_t t = 0; t < started; ++t) pthread_join(thread[t], NULL);
+    for(size_t t = 0; t < threads; ++t)
+    {
+        if(lists[t].failed) goto memoryError;
+        total += lists[t].count;
+        stats->scanTime += lists[t].scanTime;
+    }
+    stats->bytesScanned += size;
+
+    /* merge, parts are already in order */
+    queue.entries = malloc((total ? total : 1)*sizeof(*queue.entries));
+    if(queue.entries == NULL) goto memoryError;
+    {
+        const uint8_t *skipUntil = data;
+        for(size_t t = 0; t < threads; ++t)
+            for(size_t n = 0; n < lists[t].count; ++n)
+            {
+                const uint8_t *mark = lists[t].marks[n];
+                /* mark inside a file of known length */
+                if(mark < skipUntil) continue;
+                if(queue.count && queue.entries[queue.count-1].stop == NULL)
+                    queue.entries[queue.count-1].stop = mark;
+                struct entry *entry = queue.entries + queue.count++;
+                entry->start = mark;
+                entry->stop = NULL;
+                entry->exact = 0;
+                entry->written = 0;
+                if(optionLength && end - mark >= WWISE_HEADER_SIZE)
+                {
+                    size_t length = wwiseRiffLength(mark);
+                    if(length && length <= (size_t)(end - mark))
+                    {
+                        entry->stop = mark + length;
+                        entry->exact = 1;
+                        skipUntil = entry->stop;
+                    }
+                }
+            }
+        if(queue.count && queue.entries[queue.count-1].stop == NULL)
+            queue.entries[queue.count-1].stop = end;
+    }
+
+    if(index)
+    {
+        for(size_t n = 0; n < queue.count; ++n)
+        {
+            indexAdd(index, queue.entries[n].start, queue.entries[n].stop,
+                    queue.entries[n].start - data, queue.entries[n].exact);
+        }
+        stats->filesFound += queue.count;
+        result = 0;
+        goto cleanup;
+    }
+
+    /* write, files go into the pack one after another (-p) */
+    for(started = 0; started < (optionPack ? 0 : threads); ++started)
+    {
+        if(pthread_create(thread + started, NULL, writeEntries, &queue))
+            break;
+    }
+    if(started == 0) writeEntries(&queue);
+    for(size_t t = 0; t < started; ++t) pthread_join(thread[t], NULL);
+    statsAdd(stats, &queue.stats);
+
+    result = 0;
+    for(size_t n = 0; n < queue.count; ++n)
+    {
+        /* NOTE: error is already reported by the thread */
+        if(!queue.entries[n].written)
+        {
+            result = 1;
+            break;
+        }
+        snprintf(outName, outNameLength, "%s_%08llx.wav", fileName,
+                (unsigned long long)(queue.entries[n].start - data));
+        printOutput(outName);
+    }
+    /* NOTE: entries after failed one might be written, but not reported */
+    goto cleanup;
+
+memoryError:
+    fprintf(stderr, "Error allocating memory?!\nAborting.\n");
+cleanup:
+    if(lists)
+    {
+        for(size_t t = 0; t < threads; ++t) free(lists[t].marks);
+    }
+    free(queue.entries);
+    free(lists);
+    free(thread);
+    return result;
+}
+#endif /* USE_MMAP */
+
+/* splits data of the whole (mapped) input file by RIFF marks,
+   with index files are added to index instead of writing them,
+   returns 0 on success */
+static int extractMemory(const char *fileName, int fd,
+        const uint8_t *data, size_t size,
+        char *outName, size_t outNameLength, struct index *index,
+        struct stats *stats)
+{
+    uint64_t scanStart = statsClock();
+    const uint8_t *end = data + size,
+                  *start = wwiseFindRiff(data, end);
+    stats->scanTime += statsClock() - scanStart;
+    stats->bytesScanned += start - data;
+    while(start != end)
+    {
+        const uint8_t *stop, *next;
+        size_t length = 0;
+        if(optionLength && end - start >= WWISE_HEADER_SIZE)
+        {
+            length = wwiseRiffLength(start);
+            /* file that claims to be longer then the input is cut anyway */
+            if(length > (size_t)(end - start)) length = 0;
+        }
+        scanStart = statsClock();
+        if(length)
+        {
+            /* data of the file is not inspected at all */
+            stop = start + length;
+            next = wwiseFindRiff(stop, end);
+        }
+        else
+        {
+            /* NOTE: same as in extractStream(), "RIFF" right after "RIFF"
+               is the start of the next file */
+            next = wwiseFindRiff(start + 4, end);
+            stop = next;
+        }
+        stats->scanTime += statsClock() - scanStart;
+        stats->bytesScanned += next - start;
+        /* NOTE: only the header of the file of known length is checked */
+        if(length > WWISE_HEADER_SIZE)
+            stats->bytesScanned -= length - WWISE_HEADER_SIZE;
+        if(index)
+        {
+            ++stats->filesFound;
+            indexAdd(index, start, stop, start - data, length != 0);
+            start = next;
+            continue;
+        }
+        snprintf(outName, outNameLength,
+                "%s_%08llx.wav", fileName, (unsigned long long)(start - data));
+        if(writeEntry(outName, start, stop, fd, start - data, stats))
+            return 1;
+        printOutput(outName);
+        start = next;
+    }
+    return 0;
+}
+
+/* files written by extractStream() */
+struct streamOutput
+{
+    const char *fileName;
+    char *outName;
+    size_t outNameLength;
+    FILE *fileWriter;
+    struct wwiseTransform *transform; /* -t */
+    struct stats *stats;
+    struct hashState hash; /* of input bytes of the file (-d) */
+};
+
+/* wwiseDataFunction, writes to the current file, returns 1 on error */
+static int streamWrite(void *user, const uint8_t *data, size_t size)
+{
+    struct streamOutput *output = user;
+    uint64_t startTime = statsClock();
+    size_t ioStatus = writeOutput(output->fileWriter, data, size);
+    output->stats->writeTime += statsClock() - startTime;
+    ++output->stats->writeCalls;
+    output->stats->bytesWritten += size;
+    if(ioStatus == 0)
+    {
+        fprintf(stderr, "%s: Error writing to a file.\nAborting.\n",
+                output->outName);
+        return 1;
+    }
+    return 0;
+}
+
+/* wwiseBeginFunction, creates the file */
+static int streamBegin(void *user, uint64_t offset, uint64_t length)
+{
+    struct streamOutput *output = user;
+    (void)length;
+    snprintf(output->outName, output->outNameLength,
+            "%s_%08llx.wav", output->fileName, (unsigned long long)offset);
+    ++output->stats->filesFound;
+    if(optionDedup)
+    {
+        /* NOTE: the file might be linked to others, see linkDuplicate() */
+        hashBegin(&output->hash);
+#ifdef USE_LINK
+        unlink(output->outName);
+        ++output->stats->otherCalls;
+#endif /* USE_LINK */
+    }
+    output->fileWriter = createOutput(output->outName, output->stats);
+    if(output->fileWriter == NULL) return 1;
+    if(output->transform)
+    {
+        wwiseTransformInit(output->transform, streamWrite, output);
+    }
+    return 0;
+}
+
+/* wwiseDataFunction, data of the file, changed with -t */
+static int streamData(void *user, const uint8_t *data, size_t size)
+{
+    struct streamOutput *output = user;
+    if(optionDedup)
+    {
+        uint64_t startTime = statsClock();
+        hashUpdate(&output->hash, data, size);
+        output->stats->scanTime += statsClock() - startTime;
+    }
+    if(output->transform == NULL) return streamWrite(user, data, size);
+    uint64_t startTime = statsClock(), writeTime = output->stats->writeTime;
+    int result = wwiseTransformFeed(output->transform, data, size);
+    output->stats->transformTime += statsClock() - startTime -
+        (output->stats->writeTime - writeTime);
+    return result;
+}
+
+/* wwiseEndFunction, finishes the file and prints its name */
+static int streamEnd(void *user)
+{
+    struct streamOutput *output = user;
+    if(output->transform && wwiseTransformFinish(output->transform))
+    {
+        closeOutput(output->fileWriter);
+        output->fileWriter = NULL;
+        return 1;
+    }
+    FILE *fileWriter = output->fileWriter;
+    output->fileWriter = NULL;
+    if(finishFile(fileWriter, output->outName, output->stats)) return 1;
+    /* NOTE: it is known to be a duplicate only when it is written,
+       then it is replaced by the link */
+    if(optionDedup) linkDuplicate(output->outName, hashEnd(&output->hash),
+            output->hash.length, output->stats);
+    printOutput(output->outName);
+    return 0;
+}
+
+/* reads file through the buffer and splits it by RIFF marks,
+   used when the file can't be mapped into memory,
+   returns 0 on success */
+static int extractStream(const char *fileName, FILE *file,
+        char *outName, size_t outNameLength, struct stats *stats)
+{
+    static uint8_t readFile[BUFFER_SIZE];
+    static struct wwiseTransform transform;
+    struct streamOutput output = {fileName, outName, outNameLength, NULL,
+        optionTransform ? &transform : NULL, stats, {{0}, 0, {0}, 0}};
+    struct wwiseScanner scanner;
+    wwiseScannerInit(&scanner, optionLength, streamBegin, streamData,
+            streamEnd, &output);
+    /* NOTE: size of files (stdin redirected from a file too) is known,
+       so recorded lengths are checked as with mapped files,
+       with pipes they are trusted up to the end */
+    int64_t start = fileTell(file);
+    stats->otherCalls += 2;
+    if(start >= 0 && fileSeek(file, 0, SEEK_END) == 0)
+    {
+        int64_t end = fileTell(file);
+        stats->otherCalls += 2;
+        if(fileSeek(file, start, SEEK_SET))
+        {
+            fprintf(stderr, "%s: Error reading from a file.\n", fileName);
+            return 1;
+        }
+        if(end > start) scanner.size = end - start;
+    }
+    int result = 0;
+    while(!result)
+    {
+        uint64_t readStart = statsClock();
+        size_t ioStatus = fread(readFile, 1, sizeof(readFile), file);
+        stats->readTime += statsClock() - readStart;
+        ++stats->readCalls;
+        stats->bytesScanned += ioStatus;
+        if(ioStatus == 0) /* file has ended or there is error */
+        {
+            if(ferror(file))
+            {
+                fprintf(stderr, "%s: Error reading from a file.\n",
+                        fileName);
+            } /* else file is at EOF, which is good */
+            break;
+        }
+        /* NOTE: time of callbacks is counted by them */
+        uint64_t scanStart = statsClock(),
+                 callbackTime = stats->writeTime + stats->transformTime;
+        result = wwiseScannerFeed(&scanner, readFile, ioStatus);
+        stats->scanTime += statsClock() - scanStart -
+            (stats->writeTime + stats->transformTime - callbackTime);
+    }
+    /* the last file ends with the input file */
+    if(!result) result = wwiseScannerFinish(&scanner);
+    if(output.fileWriter) closeOutput(output.fileWriter);
+    return result != 0;
+}
+
+/* finds size, time of modification and hash of samples of open input file
+   (not of its name, which can be another file by now),
+   the file is at the start after that, returns 0 on success */
+static int fingerprint(FILE *file, uint64_t *size, uint64_t *mtime,
+        uint64_t *hash, struct stats *stats)
+{
+    static uint8_t sample[STATE_SAMPLE_SIZE];
+    struct stat fileStat;
+    ++stats->otherCalls;
+    if(fstat(fileno(file), &fileStat) || !S_ISREG(fileStat.st_mode))
+        return 1;
+    *size = fileStat.st_size;
+    *mtime = fileStat.st_mtime;
+    uint64_t samples = (*size + STATE_SAMPLE_SIZE - 1)/STATE_SAMPLE_SIZE;
+    if(samples > STATE_SAMPLES) samples = STATE_SAMPLES;
+    struct hashState state;
+    hashBegin(&state);
+    uint64_t readStart = statsClock();
+    for(uint64_t n = 0; n < samples; ++n)
+    {
+        /* the first and the last samples are at the ends of the file */
+        uint64_t offset = samples > 1 ?
+            (*size - STATE_SAMPLE_SIZE)*n/(samples - 1) : 0;
+        ++stats->readCalls;
+        size_t ioStatus = readAt(file, sample, STATE_SAMPLE_SIZE, offset);
+        hashUpdate(&state, sample, ioStatus);
+    }
+    stats->readTime += statsClock() - readStart;
+    *hash = hashEnd(&state);
+    ++stats->otherCalls;
+    return fileSeek(file, 0, SEEK_SET) != 0;
+}
+
+/* returns 1 when all the files extracted from the input are still there */
+static int outputsExist(const struct stateRecord *record, struct stats *stats)
+{
+    for(size_t n = 0; n < record->outputs.count; ++n)
+    {
+        struct stat fileStat;
+        ++stats->otherCalls;
+        if(stat(record->outputs.names[n], &fileStat)) return 0;
+    }
+    return 1;
+}
+
 int main(int argc, char **argv)
 {
-    if(argc < 2)
+    size_t i = 1;
+    /* NOTE: "-" is not an option, it is stdin */
+    for(; i < (size_t)argc && argv[i][0] == '-' && argv[i][1] != '\0'; ++i)
+    {
+        if(strcmp(argv[i], "--") == 0)
+        {
+            ++i;
+            break;
+        }
+        else if(strcmp(argv[i], "-l") == 0)
+        {
+            optionLength = 1;
+        }
+        else if(strcmp(argv[i], "-t") == 0)
+        {
+            optionTransform = 1;
+        }
+        else if(strcmp(argv[i], "-i") == 0)
+        {
+            optionIndex = 1;
+        }
+        else if(strcmp(argv[i], "-c") == 0)
+        {
+            optionIndex = optionCsv = 1;
+        }
+        else if(strcmp(argv[i], "--stats") == 0)
+        {
+            optionStats = 1;
+        }
+        else if(strcmp(argv[i], "-d") == 0 && i + 1 < (size_t)argc)
+        {
+#ifdef USE_LINK
+            optionDedup = argv[++i];
+#else
+            fprintf(stderr, "-d: Hard links are not supported.\n");
+            return -1;
+#endif /* USE_LINK */
+        }
+        else if(strcmp(argv[i], "--cpu") == 0 && i + 1 < (size_t)argc)
+        {
+            int level = cpuParse(argv[++i]);
+            if(level < 0) return -1;
+            wwiseSetCpuLevel(level);
+        }
+        else if(strcmp(argv[i], "-p") == 0 && i + 1 < (size_t)argc)
+        {
+            optionPack = argv[++i];
+        }
+        else if(strcmp(argv[i], "-s") == 0 && i + 1 < (size_t)argc)
+        {
+            optionState = argv[++i];
+        }
+        else if(strcmp(argv[i], "-x") == 0 && i + 1 < (size_t)argc)
+        {
+            optionSelect = argv[++i];
+            if(!isList(optionSelect))
+            {
+                fprintf(stderr, "%s: Wrong list of entries.\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "-j") == 0 && i + 1 < (size_t)argc)
+        {
+            char *numberEnd;
+            optionThreads = strtoul(argv[++i], &numberEnd, 10);
+            if(*numberEnd != '\0')
+            {
+                fprintf(stderr, "%s: Wrong number of threads.\n", argv[i]);
+                return -1;
+            }
+#ifdef USE_MMAP
+            if(optionThreads == 0) /* as much as there is processors */
+            {
+                long processors = sysconf(_SC_NPROCESSORS_ONLN);
+                optionThreads = processors > 0 ? processors : 1;
+            }
+#else
+            optionThreads = 1; /* not supported */
+#endif /* USE_MMAP */
+        }
+        else
+        {
+            fprintf(stderr, "%s: Unknown option.\n", argv[i]);
+            return -1;
+        }
+    }
+    /* NOTE: vector code is chosen before threads start, they only read it */
+    wwiseCpuLevel();
+    if(i >= (size_t)argc)
     {
-        fprintf(stderr, "Usage: %s FileName1 [FileName2...]\n"
+        fprintf(stderr, "Usage: %s [-l] [-t] [-j N] [-d TABLE] [-s STATE] [-p PACK] [-i|-c|-x LIST] [--stats] [--cpu LEVEL] [--] FileName1 [FileName2...]\n"
                 "Extracts anything resembling wave (RIFF) files and all data stored after that from provided resource files,\n"
                 "places extracted files in the same directory where input files are stored.\n"
-                /* "ignores stored length of data.\n" */
+                "  -l  stop at recorded RIFF length when header of the file looks like RIFF WAVE\n"
+                "      (otherwise stored length of data is ignored)\n"
+                "  -t  change extracted Wwise IMA ADPCM files the same way reformat does\n"
+                "  -j  search and write with N threads, 0 is for one thread per processor\n"
+                "  -d  extracted files that are the same as the ones in TABLE file are made\n"
+                "      hard links to them, new ones are added to TABLE (hashes of contents)\n"
+                "  -s  skip input files that haven't changed since they were extracted with\n"
+                "      the same options (their files are printed), STATE file keeps track of them\n"
+                "  -p  put all extracted files into PACK file (with index at the end)\n"
+                "      instead of creating them, -c lists files of PACK, -x extracts them\n"
+                "  -i  write index of extracted files to FileName.idx instead of extracting them\n"
+                "  -c  same as -i, but also print index as CSV\n"
+                "  -x  extract only entries of FileName.idx from the LIST like 0,2,5-9\n"
+                "      (entries are numbered from 0, input files are not searched)\n"
+                "  --stats  print statistics of every input file and of all of them\n"
+                "      to stderr as JSON lines\n"
+                "  --cpu  use vector code of LEVEL: generic, sse2, avx2 or avx512,\n"
+                "      instead of the best one the processor supports (for benchmarks)\n"
+                "FileName can be a directory, all the files inside it and inside directories\n"
+                "      in it are taken (in the order of names), -j N reads N directories at once\n"
+                "FileName - reads stdin (pipe is read as it goes, like any file that can't be mapped),\n"
+                "      extracted files are named stdin_XXXXXXXX.wav in current directory\n"
                 "Version r4\n"
                 , argv[0]);
         return -1;
     }
-    static uint32_t riffMark = string4ToInt32('R','I','F','F');
 
-    for(size_t i = 1; i < (size_t)argc; ++i)
+    if(optionPack && (optionDedup || optionState))
     {
-        FILE *file = fopen(argv[i], "rb");
+        fprintf(stderr, "-p can't be used with -d and -s.\n");
+        return -1;
+    }
+    if((optionDedup && dedupOpen(&dedupTable, optionDedup)) ||
+            (optionState && stateOpen(&stateTable, optionState)) ||
+            (optionPack && packBegin(optionPack)))
+    {
+        fprintf(stderr, "Aborting.\n");
+        return 1;
+    }
+    struct stats totalStats = {0};
+    uint64_t totalStart = statsClock(), inputs = 0;
+    int result = 0;
+    /* directories are replaced by all the files inside them */
+    struct fileList files = {NULL, 0, 0};
+    for(; i < (size_t)argc && !result; ++i)
+    {
+        result = strcmp(argv[i], "-") != 0 && isDirectory(argv[i]) ?
+            walkTree(&files, argv[i], NULL, optionThreads) :
+            fileListAdd(&files, argv[i], NULL);
+        if(result) fprintf(stderr, "Error allocating memory?!\nAborting.\n");
+    }
+    for(size_t n = 0; n < files.count && !result; ++n)
+    {
+        struct stats stats = {0};
+        uint64_t startTime = statsClock();
+        /* "-" is stdin, extracted files are named "stdin_%08x.wav" */
+        uint8_t isStdin = strcmp(files.names[n], "-") == 0;
+        const char *fileName = isStdin ? "stdin" : files.names[n];
+        ++stats.otherCalls;
+        FILE *file = isStdin ? stdin : fopen(fileName, "rb");
         if(file == NULL)
         {
-            fprintf(stderr, "%s: Error opening file.\n", argv[i]);
+            fprintf(stderr, "%s: Error opening file.\n", fileName);
             continue;
         }
+        ++inputs;
         /* NOTE: turn buffered i/o off because
          * 1) program is already going to do that;
          * 2) C runtime library might do something weird. See note in reformat.c*/
+#ifdef _WIN32
+        if(isStdin) _setmode(_fileno(stdin), _O_BINARY);
+#endif /* _WIN32 */
         if(setvbuf(file, NULL, _IONBF, 0))
         {
-            fprintf(stderr, "%s: Error using file?!\n", argv[i]);
-            fclose(file);
+            fprintf(stderr, "%s: Error using file?!\n", fileName);
+            if(!isStdin) fclose(file);
             continue;
         }
         uint8_t aborting = 0;
-        static uint8_t readFile[BUFFER_SIZE + 3];
-        *(uint32_t *)readFile = ~riffMark; /* definitely not a "RIFF" */
+        uint64_t stateSize = 0, stateTime = 0, stateHash = 0;
+        unsigned stateMode = optionLength | optionTransform << 1;
+        stateRecording = 0;
 
         /* name_%08x.wav */
-        size_t outNameLength = strlen(argv[i]) + 5 + 16 + 1;
+        size_t outNameLength = strlen(fileName) + 5 + 16 + 1;
         char *outName = malloc(outNameLength);
         if(outName == NULL)
         {
@@ -105,108 +1653,136 @@ int main(int argc, char **argv)
             /* free(NULL) should work */
             goto cleanup;
         }
-        size_t offset = -3; /* starts at 3 bytes rollback,
-                               size_t is unsigned, overflow is defined */
-        FILE *fileWriter = NULL;
 
-        /* read file, split it by RIFF marks */
-        while(1)
+        /* NOTE: only files that are searched and extracted are recorded */
+        if(optionState && !isStdin && !optionIndex && !optionSelect &&
+                fingerprint(file, &stateSize, &stateTime, &stateHash,
+                    &stats) == 0)
         {
-            size_t ioStatus = fread(readFile+3, 1, BUFFER_SIZE, file);
-            uint8_t *writeFile = readFile,
-                    *inspectPointer = readFile,
-                    *inspectEnd = readFile + ioStatus;
-            if(ioStatus == 0) /* file has ended or there is error */
+            struct stateRecord *record = stateFind(&stateTable, fileName);
+            if(record && record->size == stateSize &&
+                    record->mtime == stateTime && record->hash == stateHash &&
+                    record->mode == stateMode && outputsExist(record, &stats))
             {
-                if(fileWriter) /* output the last 3 bytes of the input file */
-                {
-                    fwrite(readFile, 3, 1, fileWriter);
-                    /* there is check for errors just outside the loop */
-                }
+                for(size_t k = 0; k < record->outputs.count; ++k)
+                    fprintf(stdout, "%s\n", record->outputs.names[k]);
+                ++stats.inputsSkipped;
+                goto cleanup;
+            }
+            stateRecording = 1;
+        }
 
-                if(ferror(file))
-                {
-                    fprintf(stderr, "%s: Error reading from a file.\n",
-                            argv[i]);
-                } /* else file is at EOF, which is good */
-                break;
+        /* files of pack (-p) are listed (-c) or extracted (-x) */
+        if((optionCsv || optionSelect) && !isStdin)
+        {
+            size_t indexSize;
+            uint64_t indexOffset, count;
+            uint8_t *index = packRead(file, &indexSize, &indexOffset, &count,
+                    &stats);
+            if(index)
+            {
+                aborting = extractPacked(fileName, file, index, indexSize,
+                        indexOffset, count, &stats);
+                free(index);
+                goto cleanup;
             }
+            /* NOTE: not a pack, the file is searched from the start */
+            ++stats.otherCalls;
+            fileSeek(file, 0, SEEK_SET);
+        }
 
-            /* NOTE: the program searches for RIFF files and assumes that
-               RIFF chunk length can be shorter then recorded,
-               so when there is another "RIFF" sequence
-               it just starts writing another file */
-            /* TODO: stop writing at other RIFF file _or_
-               at recorded RIFF length */
-            /* includes rollback check */
-            for(; inspectPointer < inspectEnd;
-                    ++inspectPointer)
+        if(optionSelect)
+        {
+            aborting = extractSelected(fileName, file, outName, outNameLength,
+                    &stats);
+            goto cleanup;
+        }
+
+#ifdef USE_MMAP
+        {
+            /* NOTE: pipes, empty files and such can't be mapped,
+               they go through extractStream() */
+            struct stat fileStat;
+            ++stats.otherCalls;
+            if(fstat(fileno(file), &fileStat) == 0 &&
+                    S_ISREG(fileStat.st_mode) &&
+                    (uint64_t)fileStat.st_size <= (size_t)-1)
             {
-                /* when it finds "RIFF", finish writing previous file
-                 * and open new file for writing */
-                if(*(uint32_t *)inspectPointer == riffMark)
+                size_t size = fileStat.st_size;
+                /* NOTE: mapped file is read while it is searched,
+                   so read time is only the time of mapping */
+                uint64_t readStart = statsClock();
+                void *data = size == 0 ? NULL :
+                    mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+                stats.readTime += statsClock() - readStart;
+                if(size) ++stats.otherCalls;
+                if(data != MAP_FAILED)
                 {
-                    if(fileWriter)
+                    struct index index;
+                    if(optionIndex && indexBegin(&index, fileName, size))
                     {
-                        ioStatus = fwrite(writeFile,
-                                inspectPointer - writeFile, 1, fileWriter);
-                        /* try to close the file in any case */
-                        if((ioStatus == 0) | (fclose(fileWriter) != 0))
-                        {
-                            fprintf(stderr,
-                                    "%s: Error writing to a file.\nAborting.\n",
-                                    outName);
-                            aborting = 1;
-                            goto cleanup;
-                        }
-                        fprintf(stdout, "%s\n", outName);
+                        aborting = 1;
                     }
-                    offset += inspectPointer - writeFile;
-                    snprintf(outName, outNameLength,
-                            "%s_%08lx.wav", argv[i], offset);
-                    writeFile = inspectPointer;
-                    fileWriter = fopen(outName, "wb");
-                    if(fileWriter == NULL)
+                    else
                     {
-                        fprintf(stderr, "%s: Error creating file.\nAborting.\n",
-                                outName);
-                        aborting = 1;
-                        goto cleanup;
+                        if(size) madvise(data, size, MADV_SEQUENTIAL);
+                        if(size) ++stats.otherCalls;
+                        aborting = optionThreads > 1 ?
+                            extractMemoryThreaded(fileName, fileno(file),
+                                    data, size, outName, outNameLength,
+                                    optionIndex ? &index : NULL, &stats) :
+                            extractMemory(fileName, fileno(file), data, size,
+                                    outName, outNameLength,
+                                    optionIndex ? &index : NULL, &stats);
+                        if(optionIndex) aborting = indexEnd(&index, aborting);
                     }
-                    inspectPointer += 3;
-                    /* TODO: read RIFF chunk length? */
+                    if(size) munmap(data, size);
+                    if(size) ++stats.otherCalls;
+                    goto cleanup;
                 }
             }
-            if(fileWriter)
-            {
-                ioStatus = fwrite(writeFile,
-                        inspectPointer - writeFile, 1, fileWriter);
-                if(ioStatus == 0)
-                {
-                    /* there is an error, it should have set ferror() */
-                    /* there is check for errors just outside the loop */
-                    break;
-                }
-            }
-            offset += inspectPointer - writeFile;
-            readFile[0] = inspectEnd[0],
-            readFile[1] = inspectEnd[1],
-            readFile[2] = inspectEnd[2];
         }
-        /* check for errors and try to close the file */
-        if(fileWriter && (ferror(fileWriter) | fclose(fileWriter)))
+#endif /* USE_MMAP */
+        if(optionIndex)
         {
-            fprintf(stderr, "%s: Error writing to a file.\nAborting.\n",
-                    outName);
-            aborting = 1;
+            /* NOTE: index is made only from mapped files */
+            fprintf(stderr, "%s: Can't index file that can't be mapped.\n",
+                    fileName);
             goto cleanup;
         }
-        fprintf(stdout, "%s\n", outName);
+        aborting = extractStream(fileName, file, outName, outNameLength,
+                &stats);
 
 cleanup:
+        if(stateRecording && !aborting && stateSet(&stateTable, fileName,
+                    stateSize, stateTime, stateHash, stateMode, &stateOutputs))
+        {
+            fprintf(stderr, "Error allocating memory?!\n");
+        }
+        fileListFree(&stateOutputs);
         free(outName);
-        fclose(file);
-        if(aborting) return 1;
+        if(!isStdin) fclose(file);
+        ++stats.otherCalls;
+        if(optionStats)
+        {
+            char *line = statsJson("extract", fileName, 1, &stats,
+                    statsClock() - startTime);
+            if(line) fputs(line, stderr);
+            free(line);
+            statsAdd(&totalStats, &stats);
+        }
+        result = aborting;
     }
-    return 0;
+    if(optionStats)
+    {
+        char *line = statsJson("extract", NULL, inputs, &totalStats,
+                statsClock() - totalStart);
+        if(line) fputs(line, stderr);
+        free(line);
+    }
+    fileListFree(&files);
+    if(optionDedup) result |= dedupClose(&dedupTable);
+    if(optionState) result |= stateClose(&stateTable);
+    if(optionPack) result |= packEnd();
+    return result;
 }
@@ -0,0 +1,104 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Reading and writing files at 64 bit offsets, files bigger then 4 GiB
+   work the same way with 32 bit executables,
+   shared by extract.c, reformat.c, decode.c and encode.c */
+/* NOTE: every program defines _FILE_OFFSET_BITS as 64 before the first
+   #include, so off_t, fseeko() and pread() are 64 bit on 32 bit Linux too,
+   long of fseek() is 32 bit there and on Windows */
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <limits.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+/* data is read and written at position, without seeking,
+   so threads don't share position of the file */
+#define USE_PREAD 1
+#include <unistd.h>
+#include <sys/types.h>
+#endif /* __unix__ || __APPLE__ */
+
+/* fseek() with 64 bit offset, returns 0 on success */
+static inline int fileSeek(FILE *file, int64_t offset, int whence)
+{
+#if defined(USE_PREAD)
+    return fseeko(file, (off_t)offset, whence);
+#elif defined(_WIN32)
+    return _fseeki64(file, offset, whence);
+#else
+    if(offset > LONG_MAX || offset < LONG_MIN) return 1;
+    return fseek(file, (long)offset, whence);
+#endif /* USE_PREAD */
+}
+
+/* ftell() with 64 bit result, returns -1 on error */
+static inline int64_t fileTell(FILE *file)
+{
+#if defined(USE_PREAD)
+    return ftello(file);
+#elif defined(_WIN32)
+    return _ftelli64(file);
+#else
+    return ftell(file);
+#endif /* USE_PREAD */
+}
+
+/* reads up to size bytes at offset of the file,
+   returns how much bytes were read */
+static inline size_t readAt(FILE *file, void *buffer, size_t size,
+        uint64_t offset)
+{
+#ifdef USE_PREAD
+    size_t done = 0;
+    while(done < size)
+    {
+        ssize_t ioStatus = pread(fileno(file), (uint8_t *)buffer + done,
+                size - done, (off_t)(offset + done));
+        if(ioStatus <= 0) break;
+        done += ioStatus;
+    }
+    return done;
+#else
+    if(fileSeek(file, (int64_t)offset, SEEK_SET)) return 0;
+    /* NOTE: Example of C runtime library weirdness
+     * (probably a bug, Linux x86-64, glibc 2.23):
+     * if size is more then 4096 (8192) with buffering set to default
+     * fread() of blocks always claimed to read all of them and
+     * ftell(file) is only increased by 4096. */
+    return fread(buffer, 1, size, file);
+#endif /* USE_PREAD */
+}
+
+/* writes size bytes at offset of the file,
+   returns how much bytes were written */
+static inline size_t writeAt(FILE *file, const void *buffer, size_t size,
+        uint64_t offset)
+{
+#ifdef USE_PREAD
+    size_t done = 0;
+    while(done < size)
+    {
+        ssize_t ioStatus = pwrite(fileno(file), (const uint8_t *)buffer + done,
+                size - done, (off_t)(offset + done));
+        if(ioStatus <= 0) break;
+        done += ioStatus;
+    }
+    return done;
+#else
+    if(fileSeek(file, (int64_t)offset, SEEK_SET)) return 0;
+    return fwrite(buffer, 1, size, file);
+#endif /* USE_PREAD */
+}
+
+#endif /* FILEIO_H */
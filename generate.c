@@ -0,0 +1,241 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* 64 bit offsets of files on 32 bit systems too (see fileio.h) */
+#define _FILE_OFFSET_BITS 64
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* These macros let you assign 4 byte string to 4 byte integer and
+initialize static variable because the following line has undefined behavior and
+has to be executed at run time.
+    uint32_t riffMark = *(uint32_t *)"RIFF";
+This is just overkill for 4 bytes:
+    #includes <strings.h>
+    memcpy(&riffMark, "RIFF", 4);
+*/
+/* char,char,char,char */
+/* little endian */
+#define string4ToInt32LE(a,b,c,d)  \
+    (((a) &0xff) << 0*8) |         \
+    (((b) &0xff) << 1*8) |         \
+    (((c) &0xff) << 2*8) |         \
+    (((d) &0xff) << 3*8)
+/* big endian */
+#define string4ToInt32BE(a,b,c,d)  \
+    (((d) &0xff) << 0*8) |         \
+    (((c) &0xff) << 1*8) |         \
+    (((b) &0xff) << 2*8) |         \
+    (((a) &0xff) << 3*8)
+#undef string4ToInt32BE
+#define string4ToInt32(a,b,c,d) string4ToInt32LE(a,b,c,d)
+
+/* NOTE: relies on that pointers when cast from (uint8_t *) to (uint32_t *)
+and (uint16_t *)
+work as usual when dereferenced, which, as far as I can tell,
+is Undefined Behavior, and can be compiled in unexpected ways
+so, you should probably compile with -fno-strict-aliasing */
+
+/* NOTE: the same seed gives the same file on every machine,
+   so results of benchmarks can be compared */
+static uint64_t randomState = 1 ^ 0x9E3779B97F4A7C15ull;
+
+/* xorshift64*, good enough and the same everywhere */
+static uint32_t randomNumber(void)
+{
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return (randomState * 0x2545F4914F6CDD1Dull) >> 32;
+}
+
+/* random number in [0, limit) */
+static uint32_t randomBelow(uint32_t limit)
+{
+    return limit ? (uint64_t)randomNumber() * limit >> 32 : 0;
+}
+
+static void randomFill(uint8_t *data, size_t size)
+{
+    for(size_t n = 0; n < size; ++n) data[n] = randomNumber() >> 24;
+}
+
+/* "RIFF" in the middle of nowhere, sometimes with header that
+   looks right until "fmt " */
+static void putDecoy(uint8_t *data, size_t size)
+{
+    static uint32_t riffMark = string4ToInt32('R','I','F','F');
+    static uint32_t waveMark = string4ToInt32('W','A','V','E');
+    if(size < 4) return;
+    size_t at = randomBelow(size - 3);
+    *(uint32_t *)(data + at) = riffMark;
+    if(size - at >= 12 && randomBelow(2))
+    {
+        *(uint32_t *)(data + at + 4) = randomNumber();
+        *(uint32_t *)(data + at + 8) = waveMark;
+    }
+}
+
+/* writes Wwise IMA ADPCM wave file of blocks blocks,
+   cluster of every channel is words uint32 words,
+   returns 0 on success */
+static int putWave(FILE *file, size_t channels, size_t words, size_t blocks,
+        uint32_t rate, uint8_t decoy)
+{
+    static uint32_t riffMark = string4ToInt32('R','I','F','F');
+    static uint32_t waveMark = string4ToInt32('W','A','V','E');
+    static uint32_t  fmtMark = string4ToInt32('f','m','t',' ');
+    static uint32_t dataMark = string4ToInt32('d','a','t','a');
+    size_t align = channels*words*4, samples = (words - 1)*8 + 1,
+           dataLength = blocks*align;
+    /* Wwise IMA ADPCM fmt chunk as it appears in the wild,
+       see reformat.c */
+    uint8_t header[12 + 8 + 24 + 8];
+    *(uint32_t *)header = riffMark;
+    *(uint32_t *)(header+4) = 4 + 8 + 24 + 8 + dataLength;
+    *(uint32_t *)(header+8) = waveMark;
+    *(uint32_t *)(header+12) = fmtMark;
+    *(uint32_t *)(header+16) = 24;
+    uint8_t *fmt = header + 20;
+    *(uint16_t *)fmt = 0x0002;
+    *(uint16_t *)(fmt+2) = channels;
+    *(uint32_t *)(fmt+4) = rate;
+    *(uint32_t *)(fmt+8) = (uint64_t)align*rate/samples;
+    *(uint16_t *)(fmt+12) = align;
+    *(uint16_t *)(fmt+14) = 4;
+    *(uint16_t *)(fmt+16) = 6;
+    *(uint16_t *)(fmt+18) = samples;
+    *(uint32_t *)(fmt+20) = 0;
+    *(uint32_t *)(header+44) = dataMark;
+    *(uint32_t *)(header+48) = dataLength;
+    if(fwrite(header, sizeof(header), 1, file) == 0) return 1;
+
+    uint8_t block[1 << 16];
+    for(size_t b = 0; b < blocks; ++b)
+    {
+        randomFill(block, align);
+        /* header of every channel: predictor, step index, 0 */
+        for(size_t s = 0; s < channels; ++s)
+        {
+            block[s*words*4 + 2] = randomBelow(89);
+            block[s*words*4 + 3] = 0;
+        }
+        if(decoy && randomBelow(blocks) == 0) putDecoy(block, align);
+        if(fwrite(block, align, 1, file) == 0) return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = 1000, averageSize = 64*1024, decoyPercent = 10;
+    const char *channelList = "1,2,4,6,8", *wordList = "9,9,9,5,17";
+    size_t i = 1;
+    for(; i + 1 < (size_t)argc && argv[i][0] == '-'; i += 2)
+    {
+        char *numberEnd = NULL;
+        if(strcmp(argv[i], "-s") == 0)
+        {
+            randomState = strtoull(argv[i+1], &numberEnd, 10) ^
+                0x9E3779B97F4A7C15ull;
+            /* NOTE: xorshift state can't be 0, the only seed that gives it
+               (0x9E3779B97F4A7C15) gets the state of seed 0 instead */
+            if(randomState == 0) randomState = 0x9E3779B97F4A7C15ull;
+        }
+        else if(strcmp(argv[i], "-n") == 0)
+            count = strtoul(argv[i+1], &numberEnd, 10);
+        else if(strcmp(argv[i], "-z") == 0)
+            averageSize = strtoul(argv[i+1], &numberEnd, 10)*1024;
+        else if(strcmp(argv[i], "-d") == 0)
+            decoyPercent = strtoul(argv[i+1], &numberEnd, 10);
+        else if(strcmp(argv[i], "-c") == 0)
+            channelList = argv[i+1];
+        else if(strcmp(argv[i], "-w") == 0)
+            wordList = argv[i+1];
+        else
+            break;
+        if(numberEnd && *numberEnd != '\0') break;
+    }
+    /* lists of numbers */
+    size_t channels[16], channelCount = 0, words[16], wordCount = 0;
+    for(const char *p = channelList; *p && channelCount < 16; )
+    {
+        char *numberEnd;
+        channels[channelCount] = strtoul(p, &numberEnd, 10);
+        if(numberEnd == p) break;
+        if(channels[channelCount] >= 1 && channels[channelCount] <= 16)
+            ++channelCount;
+        p = *numberEnd == ',' ? numberEnd + 1 : numberEnd;
+    }
+    for(const char *p = wordList; *p && wordCount < 16; )
+    {
+        char *numberEnd;
+        words[wordCount] = strtoul(p, &numberEnd, 10);
+        if(numberEnd == p) break;
+        if(words[wordCount] >= 2 && words[wordCount] <= 64) ++wordCount;
+        p = *numberEnd == ',' ? numberEnd + 1 : numberEnd;
+    }
+    if(i + 1 != (size_t)argc || channelCount == 0 || wordCount == 0)
+    {
+        fprintf(stderr, "Usage: %s [-s SEED] [-n FILES] [-z KiB] [-d PERCENT]\n"
+                "        [-c CHANNELS] [-w WORDS] OutFileName\n"
+                "Generates fake resource file with Wwise IMA ADPCM wave files in it,\n"
+                "the same arguments give the same file.\n"
+                "  -s  seed of random numbers (1)\n"
+                "  -n  number of wave files (1000)\n"
+                "  -z  average size of wave file in KiB (64)\n"
+                "  -d  percent of wave files with \"RIFF\" before or inside them (10)\n"
+                "  -c  list of numbers of channels to choose from (1,2,4,6,8)\n"
+                "  -w  list of uint32 words per channel in a block to choose from (9,9,9,5,17),\n"
+                "      9 words (36 bytes) is what Wwise uses\n"
+                "Version r4\n"
+                , argv[0]);
+        return -1;
+    }
+    FILE *file = fopen(argv[i], "wb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "%s: Error creating file.\n", argv[i]);
+        return 1;
+    }
+    static const uint32_t rates[] = {22050, 24000, 32000, 44100, 48000};
+    uint64_t total = 0;
+    for(size_t n = 0; n < count; ++n)
+    {
+        /* something between files, sometimes with "RIFF" in it,
+           nothing before the first one, so -n 1 makes a wave file */
+        uint8_t filler[4096];
+        size_t fillerSize = n ? randomBelow(sizeof(filler)) : 0;
+        randomFill(filler, fillerSize);
+        if(randomBelow(100) < decoyPercent) putDecoy(filler, fillerSize);
+        if(fillerSize && fwrite(filler, fillerSize, 1, file) == 0) break;
+
+        size_t fileChannels = channels[randomBelow(channelCount)],
+               fileWords = words[randomBelow(wordCount)],
+               align = fileChannels*fileWords*4,
+               /* sizes from tiny to twice the average */
+               blocks = 1 + randomBelow(2*averageSize/align + 1);
+        if(putWave(file, fileChannels, fileWords, blocks,
+                    rates[randomBelow(sizeof(rates)/sizeof(*rates))],
+                    randomBelow(100) < decoyPercent)) break;
+        total += fillerSize + 52 + blocks*align;
+    }
+    if(ferror(file) | fclose(file))
+    {
+        fprintf(stderr, "%s: Error writing to a file.\n", argv[i]);
+        return 1;
+    }
+    printf("%s: %llu wave files, %llu bytes\n", argv[i],
+            (unsigned long long)count, (unsigned long long)total);
+    return 0;
+}
@@ -8,16 +8,44 @@ The above copyright notice and this permission notice shall be included in all c
 THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+/* 64 bit offsets of files on 32 bit systems too (see fileio.h) */
+#define _FILE_OFFSET_BITS 64
+
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
 
-/* size of input and output buffers used by the program */
-#ifdef BUFSIZ
-#define BUFFER_SIZE BUFSIZ
-#else
-#define BUFFER_SIZE 4096
-#endif /* BUFSIZ */
+#include "cpu.h"
+#include "decluster.h"
+#include "wwise.h"
+#include "stats.h"
+#include "walk.h"
+#include "fileio.h"
+
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+/* several files are changed at once (-j) */
+#define USE_THREADS 1
+#include <pthread.h>
+#include <sys/stat.h>
+#endif /* __unix__ || __APPLE__ */
+
+#ifdef _WIN32
+/* stdin and stdout are switched to binary mode */
+#include <io.h>
+#include <fcntl.h>
+#endif /* _WIN32 */
+
+/* number of files changed at once (-j) */
+static size_t optionThreads = 1;
+
+/* size of input and output buffers used for data of the files,
+   file is transformed with a couple of reads and writes per window */
+#define WINDOW_SIZE (1 << 20)
 
 /* These macros let you assign 4 byte string to 4 byte integer and
 initialize static variable because the following line has undefined behavior and
@@ -49,16 +77,116 @@ work as usual when dereferenced, which, as far as I can tell,
 is Undefined Behavior, and can be compiled in unexpected ways
 so, you should probably compile with -fno-strict-aliasing */
 
-static size_t findChunk(uint32_t chunkMark, FILE *file, char *fileName)
+/* messages about one file, they are printed all at once when the file
+   is done, so they are in order even when files are changed by threads */
+struct fileLog
+{
+    char *text;
+    size_t length, capacity;
+    char *stats; /* JSON line (--stats), it goes to stderr after the text */
+};
+
+#if defined(__GNUC__)
+__attribute__((format(printf, 2, 3)))
+#endif /* __GNUC__ */
+static void logPrint(struct fileLog *log, const char *format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(log->text + log->length,
+            log->capacity - log->length, format, arguments);
+    va_end(arguments);
+    if(length < 0) return;
+    if(log->length + length >= log->capacity)
+    {
+        size_t capacity = log->capacity*2 + length + 128;
+        char *text = realloc(log->text, capacity);
+        if(text == NULL)
+        { /* better print it out of order then not at all */
+            va_start(arguments, format);
+            vprintf(format, arguments);
+            va_end(arguments);
+            return;
+        }
+        log->text = text;
+        log->capacity = capacity;
+        va_start(arguments, format);
+        vsnprintf(log->text + log->length,
+                log->capacity - log->length, format, arguments);
+        va_end(arguments);
+    }
+    log->length += length;
+}
+
+/* prints everything from the log and empties it */
+static void logFlush(struct fileLog *log)
+{
+    if(log->length) fwrite(log->text, log->length, 1, stdout);
+    log->length = 0;
+    if(log->stats)
+    {
+        /* NOTE: messages of the file come first when both go to a terminal */
+        fflush(stdout);
+        fputs(log->stats, stderr);
+        free(log->stats);
+        log->stats = NULL;
+    }
+}
+
+/* keeps statistics of the file (--stats) in the log */
+static void logStats(struct fileLog *log, const char *fileName,
+        const struct stats *stats, uint64_t elapsed)
+{
+    free(log->stats);
+    log->stats = statsJson("reformat", fileName, 1, stats, elapsed);
+}
+
+/* headers of the file are read through the first window of it,
+   which is read at once, so small files take one read */
+struct fileCursor
+{
+    FILE *file;
+    const uint8_t *cache; /* the first cached bytes of the file */
+    size_t cached;
+    uint64_t position;
+    struct stats *stats;
+};
+
+/* reads up to size bytes at the position and moves it,
+   returns how much bytes were read */
+static size_t cursorRead(struct fileCursor *cursor, void *buffer, size_t size)
+{
+    size_t done = 0;
+    if(cursor->cached < WINDOW_SIZE || cursor->position + size <= cursor->cached)
+    { /* the whole file is cached or the bytes are */
+        if(cursor->position < cursor->cached)
+            done = cursor->cached - cursor->position;
+        if(done > size) done = size;
+        memcpy(buffer, cursor->cache + cursor->position, done);
+    }
+    else
+    {
+        uint64_t readStart = statsClock();
+        done = readAt(cursor->file, buffer, size, cursor->position);
+        cursor->stats->readTime += statsClock() - readStart;
+        ++cursor->stats->readCalls;
+        cursor->stats->bytesScanned += done;
+    }
+    cursor->position += done;
+    return done;
+}
+
+static size_t findChunk(uint32_t chunkMark, struct fileCursor *cursor,
+        const char *fileName, struct fileLog *log)
 {
     size_t chunkLength = 0;
     for(size_t ioStatus = 1; ioStatus > 0;)
     {
         uint32_t chunkHead[2];
-        ioStatus = fread(chunkHead, 1, 4*2, file);
+        ioStatus = cursorRead(cursor, chunkHead, 4*2);
         if(ioStatus < 4*2)
         {
-            printf("%s: Can't find \"%.4s\" chunk.\n",
+            logPrint(log, "%s: Can't find \"%.4s\" chunk.\n",
                     fileName, (char *)&chunkMark);
             break;
         }
@@ -67,289 +195,710 @@ static size_t findChunk(uint32_t chunkMark, FILE *file, char *fileName)
             chunkLength = chunkHead[1];
             return chunkLength;
         }
-        if(fseek(file, chunkHead[1], SEEK_CUR))
+        if(chunkHead[1] > INT64_MAX - cursor->position)
         {
-            printf("%s: Can't read enough of file.\n", fileName);
+            logPrint(log, "%s: Can't read enough of file.\n", fileName);
             break;
         }
+        cursor->position += chunkHead[1];
     }
     return chunkLength;
 }
 
-/* TODO: if input is directory, process all the files inside */
-/* TODO: if stored length is less then current file length, make file smaller */
-/* TODO: account stored length of the file */
-int main(int argc, char **argv)
+/* compares speed of decluster functions of every level of vector code
+   the processor supports with the original loop
+   on blocks of usual Wwise size, returns 0 when results are the same */
+static int benchmark(void)
+{
+    /* NOTE: 1 MiB of blocks, that fits in cache, so it is
+       speed of shuffling, not memory */
+    static const size_t dataSize = 1 << 20, repeat = 512;
+    static const size_t channelList[] = {2, 4, 6, 8, 3};
+    uint32_t *in = malloc(dataSize), *out = malloc(dataSize),
+             *check = malloc(dataSize);
+    int result = 0;
+    if(in == NULL || out == NULL || check == NULL)
+    {
+        printf("Error allocating memory?!\n");
+        free(in); free(out); free(check);
+        return 1;
+    }
+    for(size_t n = 0; n < dataSize/4; ++n) in[n] = n*2654435761u;
+    for(size_t c = 0; c < sizeof(channelList)/sizeof(*channelList); ++c)
+    {
+        size_t channels = channelList[c], words = 9,
+               align = channels*words*4, blocks = dataSize/align;
+        /* the original loop and the ones of every level */
+        size_t count = 1 + cpuDetect() + 1;
+        declusterFunction *function[1 + CPU_LEVELS] = {declusterReference};
+        for(size_t f = 1; f < count; ++f)
+            function[f] = pickDecluster(channels, f - 1);
+        double speed[1 + CPU_LEVELS];
+        printf("channels %zu, block %zu bytes:", channels, align);
+        for(size_t f = 0; f < count; ++f)
+        {
+            clock_t start = clock();
+            for(size_t r = 0; r < repeat; ++r)
+                for(size_t b = 0; b < blocks; ++b)
+                    function[f](out + b*align/4, in + b*align/4,
+                            channels, words);
+            double seconds = (double)(clock() - start)/CLOCKS_PER_SEC;
+            speed[f] = seconds > 0 ?
+                (double)blocks*align*repeat/seconds/1e9 : 0;
+            if(f == 0) memcpy(check, out, blocks*align);
+            printf("%s %s %.2f GB/s%s", f ? "," : "",
+                    f ? cpuNames[f - 1] : "original", speed[f],
+                    memcmp(check, out, blocks*align) ? " WRONG RESULT" : "");
+            if(memcmp(check, out, blocks*align)) result = 1;
+        }
+        printf("\n");
+    }
+    free(in); free(out); free(check);
+    return result;
+}
+
+/* changes one file, messages about it go to the log,
+   transformIn and transformOut are WINDOW_SIZE buffers,
+   what is done is added to stats,
+   returns 1 when the program should stop, 0 otherwise */
+static int reformatFile(const char *fileName, struct fileLog *log,
+        uint8_t *transformIn, uint8_t *transformOut, struct stats *stats)
 {
     static uint32_t riffMark = string4ToInt32('R','I','F','F');
     static uint32_t waveMark = string4ToInt32('W','A','V','E');
     static uint32_t  fmtMark = string4ToInt32('f','m','t',' ');
     static uint32_t dataMark = string4ToInt32('d','a','t','a');
-    if(argc < 2)
+    /* NOTE: fclose() is counted here too */
+    stats->otherCalls += 2;
+    FILE *file = fopen(fileName, "r+b");
+    if(file == NULL)
     {
-        printf("Usage: %s FileName1 [FileName2...]\n"
-                "Assumes provided files are Wwise IMA ADPCM wave files,\n"
-                "changes CONTENTS of the provided files in a way\n"
-                "that lets them be read by complete IMA ADPCM decoders (for example, SoX).\n"
-                "Version r4\n"
-                , argv[0]);
-        return -1;
+        logPrint(log, "%s: Error opening file.\n", fileName);
+        return 0;
+    }
+    /* NOTE: turn buffered i/o off because
+     * 1) program is already going to do that;
+     * 2) C runtime library might do something weird. See another note later*/
+    if(setvbuf(file, NULL, _IONBF, 0))
+    {
+        logPrint(log, "%s: Error using file?!\n", fileName);
+        fclose(file); return 0;
     }
-    static uint16_t waveId = 0x0011;
-    for(size_t i = 1; i < (size_t)argc; ++i)
+    /* NOTE: transformIn is the cache until data is changed */
+    struct fileCursor cursor = {file, transformIn, 0, 0, stats};
+    {
+        uint64_t readStart = statsClock();
+        cursor.cached = readAt(file, transformIn, WINDOW_SIZE, 0);
+        stats->readTime += statsClock() - readStart;
+        ++stats->readCalls;
+        stats->bytesScanned += cursor.cached;
+    }
+    size_t ioStatus = 1;
+
+    uint32_t riffLenght = 0;
     {
-        FILE *file = fopen(argv[i], "r+b");
-        if(file == NULL)
+        uint32_t magick[3] = {0,0,0};
+        ioStatus = cursorRead(&cursor, magick, 4*3);
+        if(ioStatus == 0)
         {
-            printf("%s: Error opening file.\n", argv[i]);
-            continue;
+            logPrint(log, "%s: Can't read file.\n", fileName);
+            fclose(file); return 0;
         }
-        /* NOTE: turn buffered i/o off because
-         * 1) program is already going to do that;
-         * 2) C runtime library might do something weird. See another note later*/
-        if(setvbuf(file, NULL, _IONBF, 0))
+        if(ioStatus < 4*3)
         {
-            printf("%s: Error using file?!\n", argv[i]);
-            fclose(file); continue;
+            logPrint(log, "%s: File is too small.\n", fileName);
+            fclose(file); return 0;
         }
-        size_t ioStatus = 1;
+        if(magick[0] != riffMark)
+        {
+            logPrint(log, "%s: Wrong format. Expected \"RIFF\", got \"%.4s\"\n",
+                    fileName, (char *)magick);
+            fclose(file); return 0;
+        }
+
+        riffLenght = magick[1];
+
+        if(magick[2] != waveMark)
+        {
+            logPrint(log, "%s: Can't recognize format. Got \"RIFF\", "
+                    "but no \"WAVE\". Got \"%.4s\" instead\n",
+                    fileName, (char *)(magick+2));
+            fclose(file); return 0;
+        }
+    }
+
+    size_t fmtLength = findChunk(fmtMark, &cursor, fileName, log);
+    if(fmtLength == 0)
+    {
+        fclose(file); return 0;
+    }
+    if(fmtLength != 24)
+    {
+        logPrint(log, "%s: File has wrong format of data. "
+                "fmt chunk is of unexpected size (%u bytes).\n",
+                fileName, (unsigned)fmtLength);
+        fclose(file); return 0;
+    }
+
+    /* IMA ADPCM fmt chunk as described in specification
+     * fmtLength = 20;
+     * 0 rw uint16_t wFormatTag = 0x0011;
+     * 2  r uint16_t nChannels;
+     * 4    uint32_t nSamplesPerSec;
+     * 8    uint32_t nAvgBytesPerSec = (rounded up)
+     *                        = nBlockAlign*nSamplesPerSec/wSamplesPerBlock;
+     *        nBlockAlign -- bytes per block
+     * 12 r uint16_t nBlockAlign [usually] = (N+1)*4*nChannels, N=0,1,2...;
+     * 14 r uint16_t wBitsPerSample [usually] = 4;
+     * 16   uint16_t cbSize = 2;
+     * 18 w uint16_t wSamplesPerBlock =
+     * = (nBlockAlign-4*nChannels)*8/(wBitsPerSample*nChannels)+1 =
+     * = [usually] N*8+1 */
+    /* if(wBitsPerSample==3) nBlockAlign = ((N*3)+1)*4*nChannels;
+     * uint16_t wSamplesPerBlock = N*4*8+1 = N*32+1 */
+
+    /* Wwise IMA ADPCM fmt chunk as it appears in the wild
+     * fmtLength = 0x18 = 24;
+     * 0  uint16_t wFormatTag = 0x0002;
+     * 2  uint16_t nChannels;
+     * 4  uint32_t nSamplesPerSec;
+     * 8  uint32_t nAvgBytesPerSec;
+     * 12 uint16_t nBlockAlign = (0x0024 = 36)*nChannels =
+     *                         = (N+1)*4*nChannels, N = 8;
+     * 14 uint16_t wBitsPerSample = 4;
+     * 16 uint16_t cbSize = 6;
+     * 18 uint16_t unknown;
+     * 20 uint32_t dwChannelMask */
+
+    /* IMA ADPCM fmt chunk adapted to multichannel wave specification
+     * TODO: add short description */
+
+    uint64_t fmtOffset = cursor.position;
+    /* fmtLength == 24 */
+    uint8_t fmtDescription[24];
+    ioStatus = cursorRead(&cursor, fmtDescription, 24);
+    if(ioStatus < 24)
+    {
+        logPrint(log, "%s: Can't read fmt chunk.\n", fileName);
+        fclose(file); return 0;
+    }
+    uint16_t channels = *(uint16_t *)(fmtDescription+2),
+             align = *(uint16_t *)(fmtDescription+12);
+
+    {
+        uint16_t formatID = *(uint16_t *)fmtDescription,
+                 sampleBits = *(uint16_t *)(fmtDescription+14),
+                 extraSize = *(uint16_t *)(fmtDescription+16);
+        /* NOTE: 0x0011 with Wwise fmt chunk is the file changed before
+           (by reformat or extract -t), there is nothing to do */
+        if(formatID == 0x0011 && sampleBits == 4 && extraSize == 6)
+        {
+            logPrint(log, "%s: Already processed, nothing to do.\n",
+                    fileName);
+            fclose(file); return 0;
+        }
+        /* NOTE: wFormatTag and wSamplesPerBlock are changed */
+        if(!wwiseReformatFmt(fmtDescription))
+        {
+            logPrint(log, "%s: File doesn't seem to be (Wwise) IMA ADPCM wave."
+                    " It has format ID 0x%04x, bits per sample %u, "
+                    "%u bytes of extra format info, %u channels.\n",
+                    fileName, formatID, sampleBits, extraSize, channels);
+            fclose(file); return 0;
+        }
+
+        /* NOTE: in Wwise files, when there is only one channel, data is
+         * structured the same way as described in IMA ADPCM specification,
+         * when there is more -- data is "clustered", but samples (not samples,
+         * but uint32 words worth of data) are not interleaved, they are
+         * clustered one channel after another */
+#if 0
+        uint8_t *extraSection = fmtDescription+18;
+        logPrint(log, "%s ch:%u ", fileName, channels);
+        for(size_t n = 0; n < extraSize; ++n)
+            logPrint(log, "%02x", extraSection[n]);
+        logPrint(log, "\n");
+#endif
 
-        uint32_t riffLenght = 0;
+        ++stats->writeCalls;
+        stats->bytesWritten += 24;
+        ioStatus = writeAt(file, fmtDescription, 24, fmtOffset);
+        /* cached data is the same as in the file */
+        if(fmtOffset + 24 <= cursor.cached)
+            memcpy(transformIn + fmtOffset, fmtDescription, 24);
+        if(ioStatus == 0)
+        {
+            logPrint(log, "%s: Error writing to file.\nAborting.\n", fileName);
+            fclose(file);
+            return 1;
+        }
+    }
+    if(ioStatus < 24)
+    {
+        logPrint(log, "%s: Error writing to file.\nAborting.\n", fileName);
+        fclose(file);
+        return 1;
+    }
+
+    if(channels > 1)
+    { /* shuffle data to make it interleaved */
+        cursor.position = 4*3;
+        /* find "data" chunk */
+        size_t dataLength = findChunk(dataMark, &cursor, fileName, log);
+        if(dataLength == 0)
+        {
+            logPrint(log, "%s: File has no usable data...\n", fileName);
+            fclose(file); return 0;
+        }
+        /* remember the place for the later write */
+        uint64_t dataPoint = cursor.position;
+        /* NOTE: there is 4 in here because
+         * data is copied 4 bytes at a time */
+        size_t words = align/(channels*4);
+        if(words == 0)
+        {
+            logPrint(log, "%s: Block of data is too small (%u bytes).\n",
+                    fileName, align);
+            fclose(file); return 0;
+        }
+        declusterFunction *decluster = pickDecluster(channels, wwiseCpuLevel());
+        /* how much blocks of data can be placed in buffers (integer divide),
+         * nBlockAlign is 16 bit, so it is at least 16 blocks */
+        size_t transformCount = WINDOW_SIZE / align;
+        /* NOTE: the last block can be partially outside of data chunk */
+        size_t blockTotal = (dataLength + align - 1) / align;
+        for(size_t blockCount = 0; blockCount < blockTotal; )
         {
-            uint32_t magick[3] = {0,0,0};
-            ioStatus = fread(magick, 1, 4*3, file);
-            if(ioStatus == 0)
+            size_t blockAmount = blockTotal - blockCount < transformCount ?
+                blockTotal - blockCount : transformCount;
+            const uint8_t *blocks = transformIn;
+            if(cursor.cached < WINDOW_SIZE)
+            { /* the whole file is already read */
+                blocks += dataPoint;
+                ioStatus = dataPoint < cursor.cached ?
+                    cursor.cached - dataPoint : 0;
+                if(ioStatus > blockAmount*align) ioStatus = blockAmount*align;
+            }
+            else
             {
-                printf("%s: Can't read file.\n", argv[i]);
-                fclose(file); continue;
+                uint64_t readStart = statsClock();
+                ioStatus = readAt(file, transformIn, blockAmount*align, dataPoint);
+                stats->readTime += statsClock() - readStart;
+                ++stats->readCalls;
+                stats->bytesScanned += ioStatus;
             }
-            if(ioStatus < 4*3)
+            uint64_t transformStart = statsClock();
+            /* should tell you how much blocks of data
+             * the program have read */
+            blockAmount = ioStatus / align;
+            if(blockAmount == 0)
             {
-                printf("%s: File is too small.\n", argv[i]);
-                fclose(file); continue;
+                logPrint(log, "%s: Unexpected end of file.\n", fileName);
+                break;
             }
-            if(magick[0] != riffMark)
+            /* NOTE: THIS IS WHERE WE INCREMENT THE LOOP INDEX */
+            blockCount += blockAmount;
+            /* NOTE: assumes nBlockAlign is multiple of nChannels
+             * as required by the spec */
+            for(size_t block = 0; block < blockAmount; ++block)
+                decluster((uint32_t *)(transformOut+block*align),
+                        (const uint32_t *)(blocks+block*align),
+                        channels, words);
+            uint64_t writeStart = statsClock();
+            stats->transformTime += writeStart - transformStart;
+            ioStatus = writeAt(file, transformOut, blockAmount*align, dataPoint);
+            stats->writeTime += statsClock() - writeStart;
+            ++stats->writeCalls;
+            stats->bytesWritten += ioStatus;
+            if(ioStatus < blockAmount*align)
             {
-                printf("%s: Wrong format. Expected \"RIFF\", got \"%.4s\"\n",
-                        argv[i], (char *)magick);
-                fclose(file); continue;
+                logPrint(log, "%s: Error writing file.\nAborting.\n", fileName);
+                fclose(file); return 1;
             }
+            dataPoint += blockAmount*align;
+        }
+    }
+    fclose(file);
+    ++stats->filesFound;
+    logPrint(log, "Finished processing %s\n", fileName);
+    return 0;
+}
 
-            riffLenght = magick[1];
+/* wwiseDataFunction, writes changed file to stdout, returns 1 on error */
+static int writeStdout(void *user, const uint8_t *data, size_t size)
+{
+    struct stats *stats = user;
+    uint64_t startTime = statsClock();
+    size_t ioStatus = fwrite(data, size, 1, stdout);
+    stats->writeTime += statsClock() - startTime;
+    ++stats->writeCalls;
+    stats->bytesWritten += size;
+    return ioStatus == 0;
+}
 
-            if(magick[2] != waveMark)
+/* reads wave file from stdin and writes it changed to stdout,
+   data is de-clustered as it goes through, there is no seeking,
+   messages go to stderr, returns 1 on error */
+static int reformatStream(struct stats *stats)
+{
+    static uint8_t buffer[WINDOW_SIZE];
+    static struct wwiseTransform transform;
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif /* _WIN32 */
+    wwiseTransformInit(&transform, writeStdout, stats);
+    int result = 0;
+    while(!result)
+    {
+        uint64_t readStart = statsClock();
+        size_t ioStatus = fread(buffer, 1, sizeof(buffer), stdin);
+        stats->readTime += statsClock() - readStart;
+        ++stats->readCalls;
+        stats->bytesScanned += ioStatus;
+        if(ioStatus == 0)
+        {
+            if(ferror(stdin))
             {
-                printf("%s: Can't recognize format. Got \"RIFF\", "
-                        "but no \"WAVE\". Got \"%.4s\" instead\n",
-                        argv[i], (char *)(magick+2));
-                fclose(file); continue;
+                fprintf(stderr, "stdin: Can't read file.\nAborting.\n");
+                return 1;
             }
+            break;
         }
+        uint64_t transformStart = statsClock(), writeTime = stats->writeTime;
+        result = wwiseTransformFeed(&transform, buffer, ioStatus);
+        stats->transformTime += statsClock() - transformStart -
+            (stats->writeTime - writeTime);
+    }
+    if(!result) result = wwiseTransformFinish(&transform);
+    ++stats->writeCalls;
+    if(result | fflush(stdout) | ferror(stdout))
+    {
+        fprintf(stderr, "stdout: Error writing to file.\nAborting.\n");
+        return 1;
+    }
+    if(transform.changed)
+    {
+        ++stats->filesFound;
+    }
+    else
+    {
+        fprintf(stderr, "stdin: File doesn't seem to be (Wwise) IMA ADPCM wave,"
+                " it is written as is.\n");
+    }
+    return 0;
+}
+
+#ifdef USE_THREADS
+/* file to change by one of the threads */
+struct job
+{
+    const char *fileName;
+    struct fileLog log;
+    struct stats stats;
+    uint8_t done; /* log is ready to be printed */
+    uint8_t stop; /* reformatFile() asked to stop the program */
+};
 
-        size_t fmtLength = findChunk(fmtMark, file, argv[i]);
-        if(fmtLength == 0)
+/* jobs shared by the threads,
+   they are taken biggest files first, so the long ones don't end up
+   at the end of the work with one thread busy and others idle */
+struct jobQueue
+{
+    struct job *jobs;
+    size_t count;
+    size_t *order; /* indexes of jobs, biggest files first */
+    size_t next; /* in order */
+    uint8_t stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t jobDone;
+};
+
+/* thread of the pool, buffers is 2*WINDOW_SIZE bytes */
+struct worker
+{
+    struct jobQueue *queue;
+    uint8_t *buffers;
+    pthread_t thread;
+};
+
+/* thread function, takes jobs until there is none left */
+static void *doJobs(void *argument)
+{
+    struct worker *worker = argument;
+    struct jobQueue *queue = worker->queue;
+    while(1)
+    {
+        pthread_mutex_lock(&queue->lock);
+        if(queue->stopping || queue->next >= queue->count)
         {
-            fclose(file); continue;
+            pthread_mutex_unlock(&queue->lock);
+            break;
         }
-        if(fmtLength != 24)
+        struct job *job = queue->jobs + queue->order[queue->next++];
+        pthread_mutex_unlock(&queue->lock);
+
+        uint64_t startTime = statsClock();
+        uint8_t stop = reformatFile(job->fileName, &job->log,
+                worker->buffers, worker->buffers + WINDOW_SIZE, &job->stats);
+        if(optionStats)
         {
-            printf("%s: File has wrong format of data. "
-                    "fmt chunk is of unexpected size (%u bytes).\n",
-                    argv[i], fmtLength);
-            fclose(file); continue;
+            logStats(&job->log, job->fileName, &job->stats,
+                    statsClock() - startTime);
         }
 
-        /* IMA ADPCM fmt chunk as described in specification
-         * fmtLength = 20;
-         * 0 rw uint16_t wFormatTag = 0x0011;
-         * 2  r uint16_t nChannels;
-         * 4    uint32_t nSamplesPerSec;
-         * 8    uint32_t nAvgBytesPerSec = (rounded up)
-         *                        = nBlockAlign*nSamplesPerSec/wSamplesPerBlock;
-         *        nBlockAlign -- bytes per block
-         * 12 r uint16_t nBlockAlign [usually] = (N+1)*4*nChannels, N=0,1,2...;
-         * 14 r uint16_t wBitsPerSample [usually] = 4;
-         * 16   uint16_t cbSize = 2;
-         * 18 w uint16_t wSamplesPerBlock =
-         * = (nBlockAlign-4*nChannels)*8/(wBitsPerSample*nChannels)+1 =
-         * = [usually] N*8+1 */
-        /* if(wBitsPerSample==3) nBlockAlign = ((N*3)+1)*4*nChannels;
-         * uint16_t wSamplesPerBlock = N*4*8+1 = N*32+1 */
-
-        /* Wwise IMA ADPCM fmt chunk as it appears in the wild
-         * fmtLength = 0x18 = 24;
-         * 0  uint16_t wFormatTag = 0x0002;
-         * 2  uint16_t nChannels;
-         * 4  uint32_t nSamplesPerSec;
-         * 8  uint32_t nAvgBytesPerSec;
-         * 12 uint16_t nBlockAlign = (0x0024 = 36)*nChannels =
-         *                         = (N+1)*4*nChannels, N = 8;
-         * 14 uint16_t wBitsPerSample = 4;
-         * 16 uint16_t cbSize = 6;
-         * 18 uint16_t unknown;
-         * 20 uint32_t dwChannelMask */
-
-        /* IMA ADPCM fmt chunk adapted to multichannel wave specification
-         * TODO: add short description */
-
-        long fmtOffset = ftell(file);
-        if(fmtOffset < 0)
+        pthread_mutex_lock(&queue->lock);
+        job->stop = stop;
+        job->done = 1;
+        pthread_cond_broadcast(&queue->jobDone);
+        pthread_mutex_unlock(&queue->lock);
+    }
+    return NULL;
+}
+
+/* file size and position in the list of files, to sort them */
+struct sizedFile
+{
+    uint64_t size;
+    size_t index;
+};
+
+static int biggerFirst(const void *a, const void *b)
+{
+    const struct sizedFile *x = a, *y = b;
+    if(x->size != y->size) return x->size < y->size ? 1 : -1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/* same as calling reformatFile() for every file, but with optionThreads
+   threads, messages are printed in the same order as files are given,
+   stats of printed files are added to totalStats,
+   returns 1 when the program should stop, 0 otherwise */
+static int reformatThreaded(char **files, size_t count,
+        struct stats *totalStats)
+{
+    size_t threads = optionThreads < count ? optionThreads : count;
+    struct jobQueue queue = {NULL, count, NULL, 0, 0,
+        PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+    struct sizedFile *sizes = malloc(count*sizeof(*sizes));
+    struct worker *workers = calloc(threads, sizeof(*workers));
+    queue.jobs = calloc(count, sizeof(*queue.jobs));
+    queue.order = malloc(count*sizeof(*queue.order));
+    int result = 1;
+    if(sizes == NULL || workers == NULL || queue.jobs == NULL ||
+            queue.order == NULL)
+    {
+        printf("Error allocating memory?!\nAborting.\n");
+        goto cleanup;
+    }
+
+    /* NOTE: files that can't be checked are just the last ones,
+       reformatFile() reports what is wrong with them */
+    for(size_t n = 0; n < count; ++n)
+    {
+        struct stat fileStat;
+        queue.jobs[n].fileName = files[n];
+        sizes[n].index = n;
+        sizes[n].size = stat(files[n], &fileStat) == 0 ? fileStat.st_size : 0;
+    }
+    qsort(sizes, count, sizeof(*sizes), biggerFirst);
+    for(size_t n = 0; n < count; ++n) queue.order[n] = sizes[n].index;
+
+    size_t started = 0;
+    for(; started < threads; ++started)
+    {
+        workers[started].queue = &queue;
+        workers[started].buffers = malloc(2*WINDOW_SIZE);
+        if(workers[started].buffers == NULL) break;
+        if(pthread_create(&workers[started].thread, NULL,
+                    doJobs, workers + started))
         {
-            printf("%s: Error using file?!\n", argv[i]);
-            fclose(file); continue;
+            free(workers[started].buffers);
+            break;
         }
-        /* fmtLength == 24 */
-        static uint8_t fmtDescription[24];
-        ioStatus = fread(fmtDescription, 1, 24, file);
-        if(ioStatus < 24)
+    }
+    if(started == 0)
+    {
+        printf("Error starting threads?!\nAborting.\n");
+        goto cleanup;
+    }
+
+    result = 0;
+    for(size_t n = 0; n < count && !result; ++n)
+    {
+        struct job *job = queue.jobs + n;
+        pthread_mutex_lock(&queue.lock);
+        while(!job->done) pthread_cond_wait(&queue.jobDone, &queue.lock);
+        if(job->stop) queue.stopping = 1;
+        pthread_mutex_unlock(&queue.lock);
+        logFlush(&job->log);
+        statsAdd(totalStats, &job->stats);
+        result = job->stop;
+    }
+    /* NOTE: when the program is stopped, some of the files
+       after the one that caused it might be changed, but not reported */
+    for(size_t t = 0; t < started; ++t)
+    {
+        pthread_join(workers[t].thread, NULL);
+        free(workers[t].buffers);
+    }
+
+cleanup:
+    if(queue.jobs)
+    {
+        for(size_t n = 0; n < count; ++n)
         {
-            printf("%s: Can't read fmt chunk.\n", argv[i]);
-            fclose(file); continue;
+            free(queue.jobs[n].log.text);
+            free(queue.jobs[n].log.stats);
         }
-        uint16_t channels = *(uint16_t *)(fmtDescription+2),
-                 align = *(uint16_t *)(fmtDescription+12);
+    }
+    free(queue.jobs);
+    free(queue.order);
+    free(workers);
+    free(sizes);
+    return result;
+}
+#endif /* USE_THREADS */
 
+/* TODO: if stored length is less then current file length, make file smaller */
+/* TODO: account stored length of the file */
+int main(int argc, char **argv)
+{
+    if(argc == 2 && strcmp(argv[1], "--benchmark") == 0)
+    {
+        return benchmark();
+    }
+    size_t i = 1;
+    /* NOTE: "-" is not an option, it is stdin */
+    for(; i < (size_t)argc && argv[i][0] == '-' && argv[i][1] != '\0'; ++i)
+    {
+        if(strcmp(argv[i], "--") == 0)
         {
-            uint16_t formatID = *(uint16_t *)fmtDescription,
-                     sampleBits = *(uint16_t *)(fmtDescription+14),
-                     extraSize = *(uint16_t *)(fmtDescription+16);
-            /* probably shouldn't accept 0x11 */
-            /* (formatID == 0x0002 || formatID == 0x0011) */
-            if(!( formatID == 0x0002 && sampleBits == 4 &&
-                        extraSize == 6 ))
-            {
-                printf("%s: File doesn't seem to be (Wwise) IMA ADPCM wave."
-                        " It has format ID 0x%04x, bits per sample %u, "
-                        "%u bytes of extra format info.\n",
-                        argv[i], formatID, sampleBits, extraSize);
-                fclose(file); continue;
-            }
-            /* wFormatTag */
-            *(uint16_t *)fmtDescription = waveId;
-            /* wSamplesPerBlock */
-            *(uint16_t *)(fmtDescription+18) = (align-4*channels)*8/(sampleBits*channels)+1;
-
-            /* TODO: dwChannelMask */
-            /* NOTE: in Wwise files, when there is only one channel, data is
-             * structured the same way as described in IMA ADPCM specification,
-             * when there is more -- data is "clustered", but samples (not samples,
-             * but uint32 words worth of data) are not interleaved, they are
-             * clustered one channel after another */
-#if 0
-            static uint8_t *extraSection = fmtDescription+18;
-            printf("%s ch:%u ", argv[i], channels);
-            for(size_t n = 0; n < extraSize; ++n)
-                printf("%02x", extraSection[n]);
-            printf("\n");
-#endif
-
-            if(fseek(file, fmtOffset, SEEK_SET))
+            ++i;
+            break;
+        }
+        else if(strcmp(argv[i], "--stats") == 0)
+        {
+            optionStats = 1;
+        }
+        else if(strcmp(argv[i], "--cpu") == 0 && i + 1 < (size_t)argc)
+        {
+            int level = cpuParse(argv[++i]);
+            if(level < 0) return -1;
+            wwiseSetCpuLevel(level);
+        }
+        else if(strcmp(argv[i], "-j") == 0 && i + 1 < (size_t)argc)
+        {
+            char *numberEnd;
+            optionThreads = strtoul(argv[++i], &numberEnd, 10);
+            if(*numberEnd != '\0')
             {
-                printf("%s: Error using file?!\n", argv[i]);
-                fclose(file); continue;
+                printf("%s: Wrong number of threads.\n", argv[i]);
+                return -1;
             }
-            ioStatus = fwrite(fmtDescription, 1, 24, file);
-            if(ioStatus == 0)
+#ifdef USE_THREADS
+            if(optionThreads == 0) /* as much as there is processors */
             {
-                printf("%s: Error writing to file.\nAborting.\n", argv[i]);
-                fclose(file);
-                return 1;
+                long processors = sysconf(_SC_NPROCESSORS_ONLN);
+                optionThreads = processors > 0 ? processors : 1;
             }
+#else
+            optionThreads = 1; /* not supported */
+#endif /* USE_THREADS */
         }
-        if(ioStatus < 24)
+        else
         {
-            printf("%s: Error writing to file.\nAborting.\n", argv[i]);
-            fclose(file);
+            printf("%s: Unknown option.\n", argv[i]);
+            return -1;
+        }
+    }
+    /* NOTE: vector code is chosen before threads start, they only read it */
+    wwiseCpuLevel();
+    if(i >= (size_t)argc)
+    {
+        printf("Usage: %s [-j N] [--stats] [--cpu LEVEL] [--] FileName1 [FileName2...]\n"
+                "Assumes provided files are Wwise IMA ADPCM wave files,\n"
+                "changes CONTENTS of the provided files in a way\n"
+                "that lets them be read by complete IMA ADPCM decoders (for example, SoX).\n"
+                "  -j  change N files at once, 0 is for one file per processor\n"
+                "      (messages are printed in the same order anyway)\n"
+                "FileName can be a directory, all .wav files inside it and inside directories\n"
+                "      in it are changed (in the order of names), -j N reads N directories at once\n"
+                "  --stats  print statistics of every file and of all of them\n"
+                "      to stderr as JSON lines\n"
+                "  --cpu  use vector code of LEVEL: generic, sse2, avx2 or avx512,\n"
+                "      instead of the best one the processor supports (for benchmarks)\n"
+                "%s [--stats] - reads wave file from stdin and writes changed one to stdout\n"
+                "      (messages go to stderr)\n"
+                "%s --benchmark compares speed of data shuffling of every level with the original one.\n"
+                "Version r4\n"
+                , argv[0], argv[0], argv[0]);
+        return -1;
+    }
+    struct stats totalStats = {0};
+    uint64_t totalStart = statsClock();
+    int result = 0;
+    if(argc - i == 1 && strcmp(argv[i], "-") == 0)
+    {
+        result = reformatStream(&totalStats);
+        if(optionStats)
+        {
+            char *line = statsJson("reformat", "-", 1, &totalStats,
+                    statsClock() - totalStart);
+            if(line) fputs(line, stderr);
+            free(line);
+        }
+        return result;
+    }
+    /* directories are replaced by all .wav files inside them */
+    struct fileList list = {NULL, 0, 0};
+    for(; i < (size_t)argc; ++i)
+    {
+        if(isDirectory(argv[i]) ?
+                walkTree(&list, argv[i], ".wav", optionThreads) :
+                fileListAdd(&list, argv[i], NULL))
+        {
+            printf("Error allocating memory?!\nAborting.\n");
+            fileListFree(&list);
             return 1;
         }
-
-        if(channels > 1)
-        { /* shuffle data to make it interleaved */
-            if(fseek(file, 4*3, SEEK_SET))
-            {
-                printf("%s: Error using file?!\n", argv[i]);
-                fclose(file); continue;
-            }
-            /* find "data" chunk */
-            size_t dataLength = findChunk(dataMark, file, argv[i]);
-            if(dataLength == 0)
-            {
-                printf("%s: File has no usable data...\n", argv[i]);
-                fclose(file); continue;
-            }
-            static uint8_t transformInData[BUFFER_SIZE], transformOutData[BUFFER_SIZE];
-            uint8_t *transformIn = transformInData,
-                    *transformOut = transformOutData;
-            /* how much blocks of data can be placed in buffers (integer divide) */
-            size_t transformCount = BUFFER_SIZE / align;
-            if(align > BUFFER_SIZE) /* just in case */
-            {
-                transformIn = malloc(2*align);
-                transformOut = transformIn + align;
-                transformCount = 1;
-            }
-            for(size_t blockCount = 0;
-                    blockCount*align < dataLength; )
-            {
-                /* remember the place for the later write */
-                long dataPoint = ftell(file);
-                if(dataPoint < 0)
-                {
-                    printf("%s: Error using file?!\n", argv[i]);
-                    break;
-                }
-                /* NOTE: Example of C runtime library weirdness
-                 * (probably a bug, Linux x86-64, glibc 2.23): */
-                ioStatus = fread(transformIn, align, transformCount, file);
-                /* if align*transformCount is more then 4096 (8192)
-                 * with buffering set to default
-                 * ioStatus is always assigned transformCount and
-                 * ftell(file) is only increased by 4096. */
-#if 0
-                printf("read: %zu\n", ftell(file) - dataPoint);
-#endif
-                if(ioStatus == 0)
-                {
-                    printf("%s: Unexpected end of file.\n", argv[i]);
-                    break;
-                }
-                /* should tell you how much blocks of data
-                 * the program have read */
-                size_t blockAmount = ioStatus;
-                /* NOTE: THIS IS WHERE WE INCREMENT THE LOOP INDEX */
-                blockCount += blockAmount;
-                /* NOTE: assumes nBlockAlign is multiple of nChannels
-                 * as required by the spec */
-                for(size_t block = 0; block < blockAmount; ++block)
-                    for(size_t n = 0;
-                            /* NOTE: there is 4 in here because
-                             * data is copied 4 bytes at a time */
-                            n < align/(channels*4);
-                            ++n)
-                        for(size_t s = 0; s < channels; ++s)
-                        {
-                            ((uint32_t *)(transformOut+block*align))[n*channels+s] =
-                                ((uint32_t *)(transformIn+block*align))[s*align/(channels*4)+n];
-                        }
-                if(fseek(file, dataPoint, SEEK_SET))
-                {
-                    printf("%s: Error using file?!\n", argv[i]);
-                    break;
-                }
-                ioStatus = fwrite(transformOut, (blockAmount*align), 1, file);
-                if(ioStatus == 0)
-                {
-                    printf("%s: Error writing file.\nAborting.\n", argv[i]);
-                    fclose(file); return 1;
-                }
-            }
-            if(align > BUFFER_SIZE) /* just in case */
+    }
+    char **files = list.names;
+    size_t count = list.count;
+#ifdef USE_THREADS
+    if(optionThreads > 1 && count > 1)
+    {
+        result = reformatThreaded(files, count, &totalStats);
+    }
+    else
+#endif /* USE_THREADS */
+    {
+        static uint8_t transformIn[WINDOW_SIZE], transformOut[WINDOW_SIZE];
+        struct fileLog log = {NULL, 0, 0, NULL};
+        for(size_t n = 0; n < count && !result; ++n)
+        {
+            struct stats stats = {0};
+            uint64_t startTime = statsClock();
+            result = reformatFile(files[n], &log, transformIn, transformOut,
+                    &stats);
+            if(optionStats)
             {
-                free(transformIn);
+                logStats(&log, files[n], &stats, statsClock() - startTime);
             }
+            logFlush(&log);
+            statsAdd(&totalStats, &stats);
         }
-        fclose(file);
-        printf("Finished processing %s\n", argv[i]);
+        free(log.text);
+        free(log.stats);
     }
-    return 0;
+    if(optionStats)
+    {
+        char *line = statsJson("reformat", NULL, count, &totalStats,
+                statsClock() - totalStart);
+        fflush(stdout);
+        if(line) fputs(line, stderr);
+        free(line);
+    }
+    fileListFree(&list);
+    return result;
 }
@@ -1,9 +1,17 @@
 #!/bin/sh
-gcc  -o extract.x86_64 -m64 -mtune=generic -O2 extract.c
-gcc -o reformat.x86_64 -m64 -mtune=generic -O2 reformat.c
-gcc  -o extract.x86 -m32 -mtune=generic -O2 extract.c
-gcc -o reformat.x86 -m32 -mtune=generic -O2 reformat.c
-i686-w64-mingw32-gcc  -o extract.x86.exe -mtune=generic -O2 extract.c
-i686-w64-mingw32-gcc -o reformat.x86.exe -mtune=generic -O2 reformat.c
-x86_64-w64-mingw32-gcc  -o extract.x86_64.exe -mtune=generic -O2 extract.c
-x86_64-w64-mingw32-gcc -o reformat.x86_64.exe -mtune=generic -O2 reformat.c
+gcc  -o extract.x86_64 -m64 -mtune=generic -O2 -pthread extract.c wwise.c
+gcc -o reformat.x86_64 -m64 -mtune=generic -O2 -pthread reformat.c wwise.c
+gcc  -o decode.x86_64 -m64 -mtune=generic -O2 -pthread decode.c wwise.c
+gcc  -o encode.x86_64 -m64 -mtune=generic -O2 -pthread encode.c
+gcc  -o extract.x86 -m32 -mtune=generic -O2 -pthread extract.c wwise.c
+gcc -o reformat.x86 -m32 -mtune=generic -O2 -pthread reformat.c wwise.c
+gcc  -o decode.x86 -m32 -mtune=generic -O2 -pthread decode.c wwise.c
+gcc  -o encode.x86 -m32 -mtune=generic -O2 -pthread encode.c
+i686-w64-mingw32-gcc  -o extract.x86.exe -mtune=generic -O2 extract.c wwise.c
+i686-w64-mingw32-gcc -o reformat.x86.exe -mtune=generic -O2 reformat.c wwise.c
+i686-w64-mingw32-gcc  -o decode.x86.exe -mtune=generic -O2 decode.c wwise.c
+i686-w64-mingw32-gcc  -o encode.x86.exe -mtune=generic -O2 encode.c
+x86_64-w64-mingw32-gcc  -o extract.x86_64.exe -mtune=generic -O2 extract.c wwise.c
+x86_64-w64-mingw32-gcc -o reformat.x86_64.exe -mtune=generic -O2 reformat.c wwise.c
+x86_64-w64-mingw32-gcc  -o decode.x86_64.exe -mtune=generic -O2 decode.c wwise.c
+x86_64-w64-mingw32-gcc  -o encode.x86_64.exe -mtune=generic -O2 encode.c
@@ -0,0 +1,210 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* State of previous runs (extract -s): input files with their size,
+   time of modification and hash of samples of their contents,
+   and the files extracted from them, so unchanged files are skipped */
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "walk.h" /* struct fileList,fileListAdd,fileListFree */
+
+/* state file is the text of lines
+       I size mtime hash mode path
+       O path
+   where O lines are files extracted from the I line above them,
+   hash is 16 hex digits, mode is options the files were extracted with */
+struct stateRecord
+{
+    char *path;
+    uint64_t size, mtime, hash;
+    unsigned mode;
+    struct fileList outputs;
+};
+
+struct stateTable
+{
+    struct stateRecord *records;
+    size_t count, capacity;
+    size_t sorted; /* records[0, sorted) are sorted by path */
+    const char *fileName;
+};
+
+static inline int stateCompare(const void *a, const void *b)
+{
+    return strcmp(((const struct stateRecord *)a)->path,
+            ((const struct stateRecord *)b)->path);
+}
+
+/* adds empty record for path, returns it or NULL when there is no memory */
+static inline struct stateRecord *stateAdd(struct stateTable *table,
+        const char *path)
+{
+    if(table->count == table->capacity)
+    {
+        size_t capacity = table->capacity ? table->capacity*2 : 256;
+        struct stateRecord *records = realloc(table->records,
+                capacity*sizeof(*records));
+        if(records == NULL) return NULL;
+        table->records = records;
+        table->capacity = capacity;
+    }
+    size_t pathLength = strlen(path) + 1;
+    char *copy = malloc(pathLength);
+    if(copy == NULL) return NULL;
+    memcpy(copy, path, pathLength);
+    struct stateRecord *record = table->records + table->count++;
+    memset(record, 0, sizeof(*record));
+    record->path = copy;
+    return record;
+}
+
+/* reads the state from fileName if there is one, returns 0 on success */
+static inline int stateOpen(struct stateTable *table, const char *fileName)
+{
+    table->records = NULL;
+    table->count = table->capacity = table->sorted = 0;
+    table->fileName = fileName;
+    FILE *file = fopen(fileName, "r");
+    if(file == NULL) return 0; /* the first run */
+    static char line[4096 + 128];
+    struct stateRecord *record = NULL;
+    int result = 0;
+    while(!result && fgets(line, sizeof(line), file))
+    {
+        size_t lineLength = strlen(line);
+        if(lineLength && line[lineLength-1] == '\n') line[--lineLength] = '\0';
+        unsigned long long size, mtime, hash;
+        unsigned mode;
+        int pathStart = 0;
+        if(line[0] == 'I' && sscanf(line, "I %llu %llu %16llx %u %n",
+                    &size, &mtime, &hash, &mode, &pathStart) >= 4 &&
+                pathStart)
+        {
+            record = stateAdd(table, line + pathStart);
+            if(record == NULL) result = 1;
+            else
+            {
+                record->size = size;
+                record->mtime = mtime;
+                record->hash = hash;
+                record->mode = mode;
+            }
+        }
+        else if(line[0] == 'O' && line[1] == ' ' && record)
+        {
+            result = fileListAdd(&record->outputs, line + 2, NULL);
+        }
+    }
+    fclose(file);
+    if(result)
+    {
+        fprintf(stderr, "Error allocating memory?!\n");
+        return 1;
+    }
+    /* NOTE: the file is written with one record for every path */
+    qsort(table->records, table->count, sizeof(*table->records),
+            stateCompare);
+    table->sorted = table->count;
+    return 0;
+}
+
+/* returns record of path or NULL */
+static inline struct stateRecord *stateFind(struct stateTable *table,
+        const char *path)
+{
+    struct stateRecord key;
+    key.path = (char *)path;
+    struct stateRecord *record = table->sorted ? bsearch(&key, table->records,
+            table->sorted, sizeof(*table->records), stateCompare) : NULL;
+    /* records added by this run */
+    for(size_t n = table->sorted; record == NULL && n < table->count; ++n)
+        if(strcmp(table->records[n].path, path) == 0)
+            record = table->records + n;
+    return record;
+}
+
+/* records that files in outputs were made of path,
+   outputs are moved into the table, returns 0 on success */
+static inline int stateSet(struct stateTable *table, const char *path,
+        uint64_t size, uint64_t mtime, uint64_t hash, unsigned mode,
+        struct fileList *outputs)
+{
+    struct stateRecord *record = stateFind(table, path);
+    if(record == NULL) record = stateAdd(table, path);
+    if(record == NULL) return 1;
+    record->size = size;
+    record->mtime = mtime;
+    record->hash = hash;
+    record->mode = mode;
+    fileListFree(&record->outputs);
+    record->outputs = *outputs;
+    outputs->names = NULL;
+    outputs->count = outputs->capacity = 0;
+    return 0;
+}
+
+/* writes the state to the file (through temporary file, so the old state
+   is there until the new one is complete) and frees the table,
+   returns 0 on success */
+static inline int stateClose(struct stateTable *table)
+{
+    size_t fileNameLength = strlen(table->fileName);
+    char *tempName = malloc(fileNameLength + 2);
+    FILE *file = NULL;
+    if(tempName)
+    {
+        memcpy(tempName, table->fileName, fileNameLength);
+        memcpy(tempName + fileNameLength, "~", 2);
+        file = fopen(tempName, "w");
+    }
+    if(file)
+    {
+        for(size_t n = 0; n < table->count; ++n)
+        {
+            struct stateRecord *record = table->records + n;
+            /* NOTE: names with new lines can't be written, such files
+               are extracted every time */
+            uint8_t broken = strchr(record->path, '\n') != NULL;
+            for(size_t k = 0; k < record->outputs.count; ++k)
+                broken |= strchr(record->outputs.names[k], '\n') != NULL;
+            if(broken) continue;
+            fprintf(file, "I %llu %llu %016llx %u %s\n",
+                    (unsigned long long)record->size,
+                    (unsigned long long)record->mtime,
+                    (unsigned long long)record->hash, record->mode,
+                    record->path);
+            for(size_t k = 0; k < record->outputs.count; ++k)
+                fprintf(file, "O %s\n", record->outputs.names[k]);
+        }
+    }
+    int result = 0;
+    if(file == NULL || (ferror(file) | fclose(file)) ||
+            rename(tempName, table->fileName))
+    {
+        fprintf(stderr, "%s: Error writing to a file.\n", table->fileName);
+        result = 1;
+    }
+    free(tempName);
+    for(size_t n = 0; n < table->count; ++n)
+    {
+        free(table->records[n].path);
+        fileListFree(&table->records[n].outputs);
+    }
+    free(table->records);
+    return result;
+}
+
+#endif /* STATE_H */
@@ -0,0 +1,124 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Statistics printed with --stats as JSON lines,
+   shared by extract.c and reformat.c */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* collect and print statistics (--stats) */
+static uint8_t optionStats = 0;
+
+/* NOTE: calls are counted where the program calls i/o functions,
+   that is about the number of system calls, since the files are
+   unbuffered or written in big pieces, but not exactly that.
+   Times are in nanoseconds, when the work is done by several threads
+   their times are summed, so they can be bigger then the wall time */
+struct stats
+{
+    uint64_t bytesScanned; /* bytes of input read or searched */
+    uint64_t bytesWritten;
+    uint64_t filesFound; /* extracted or changed files */
+    uint64_t filesLinked, bytesLinked; /* duplicates not written (-d) */
+    uint64_t inputsSkipped; /* unchanged since the previous run (-s) */
+    uint64_t readCalls, writeCalls;
+    uint64_t otherCalls; /* open, close, seek, map and such */
+    uint64_t readTime, scanTime, writeTime, transformTime;
+};
+
+/* nanoseconds from some point in the past,
+   always 0 without --stats, so it costs nothing */
+static inline uint64_t statsClock(void)
+{
+    if(!optionStats) return 0;
+#if defined(CLOCK_MONOTONIC)
+    struct timespec now;
+    if(clock_gettime(CLOCK_MONOTONIC, &now) == 0)
+        return (uint64_t)now.tv_sec*1000000000 + now.tv_nsec;
+#endif /* CLOCK_MONOTONIC */
+    /* NOTE: processor time, but better than nothing */
+    return (uint64_t)clock()*1000000000/CLOCKS_PER_SEC;
+}
+
+static inline void statsAdd(struct stats *total, const struct stats *part)
+{
+    total->bytesScanned += part->bytesScanned;
+    total->bytesWritten += part->bytesWritten;
+    total->filesFound += part->filesFound;
+    total->filesLinked += part->filesLinked;
+    total->bytesLinked += part->bytesLinked;
+    total->inputsSkipped += part->inputsSkipped;
+    total->readCalls += part->readCalls;
+    total->writeCalls += part->writeCalls;
+    total->otherCalls += part->otherCalls;
+    total->readTime += part->readTime;
+    total->scanTime += part->scanTime;
+    total->writeTime += part->writeTime;
+    total->transformTime += part->transformTime;
+}
+
+/* returns JSON line (with '\n') about file fileName, or about all files
+   when fileName is NULL, elapsed is wall time in nanoseconds,
+   the line has to be freed, NULL when there is no memory */
+static inline char *statsJson(const char *tool, const char *fileName,
+        uint64_t inputs, const struct stats *stats, uint64_t elapsed)
+{
+    /* NOTE: every character of the name takes at most 6 ("\u001f") */
+    size_t nameLength = fileName ? strlen(fileName) : 0,
+           capacity = nameLength*6 + 768;
+    char *text = malloc(capacity), *p = text;
+    if(text == NULL) return NULL;
+    p += sprintf(p, "{\"tool\":\"%s\",", tool);
+    if(fileName)
+    {
+        p += sprintf(p, "\"file\":\"");
+        for(const char *c = fileName; *c; ++c)
+        {
+            if(*c == '"' || *c == '\\') p += sprintf(p, "\\%c", *c);
+            else if((unsigned char)*c < 0x20)
+                p += sprintf(p, "\\u%04x", (unsigned)*c);
+            else *p++ = *c;
+        }
+        p += sprintf(p, "\",");
+    }
+    else
+    {
+        p += sprintf(p, "\"inputs\":%llu,", (unsigned long long)inputs);
+    }
+    double seconds = elapsed/1e9;
+    sprintf(p, "\"bytesScanned\":%llu,\"bytesWritten\":%llu,\"files\":%llu,"
+            "\"linked\":%llu,\"bytesLinked\":%llu,"
+            "\"skipped\":%llu,\"calls\":{\"read\":%llu,\"write\":%llu,\"other\":%llu},"
+            "\"seconds\":{\"read\":%.6f,\"scan\":%.6f,\"write\":%.6f,"
+            "\"transform\":%.6f,\"total\":%.6f},"
+            "\"MBps\":%.1f,\"filesPerSecond\":%.1f}\n",
+            (unsigned long long)stats->bytesScanned,
+            (unsigned long long)stats->bytesWritten,
+            (unsigned long long)stats->filesFound,
+            (unsigned long long)stats->filesLinked,
+            (unsigned long long)stats->bytesLinked,
+            (unsigned long long)stats->inputsSkipped,
+            (unsigned long long)stats->readCalls,
+            (unsigned long long)stats->writeCalls,
+            (unsigned long long)stats->otherCalls,
+            stats->readTime/1e9, stats->scanTime/1e9, stats->writeTime/1e9,
+            stats->transformTime/1e9, seconds,
+            seconds > 0 ? stats->bytesScanned/seconds/1e6 : 0,
+            seconds > 0 ? stats->filesFound/seconds : 0);
+    return text;
+}
+
+#endif /* STATS_H */
@@ -0,0 +1,270 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Lists of input files with directories replaced by the files in them,
+   shared by extract.c and reformat.c */
+#ifndef WALK_H
+#define WALK_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+/* directories are read by several threads */
+#define WALK_THREADS 1
+#include <pthread.h>
+#endif /* __unix__ || __APPLE__ */
+
+struct fileList
+{
+    char **names;
+    size_t count, capacity;
+};
+
+/* adds copy of name (with "/" and name2 after it, if it is not NULL),
+   returns 0 on success */
+static inline int fileListAdd(struct fileList *list,
+        const char *name, const char *name2)
+{
+    if(list->count == list->capacity)
+    {
+        size_t capacity = list->capacity ? list->capacity*2 : 64;
+        char **names = realloc(list->names, capacity*sizeof(*names));
+        if(names == NULL) return 1;
+        list->names = names;
+        list->capacity = capacity;
+    }
+    size_t length = strlen(name), length2 = name2 ? strlen(name2) : 0;
+    char *copy = malloc(length + 1 + length2 + 1);
+    if(copy == NULL) return 1;
+    memcpy(copy, name, length + 1);
+    if(name2)
+    {
+        copy[length] = '/';
+        memcpy(copy + length + 1, name2, length2 + 1);
+    }
+    list->names[list->count++] = copy;
+    return 0;
+}
+
+/* moves all names from list from to the end of list to,
+   returns 0 on success */
+static inline int fileListMove(struct fileList *to, struct fileList *from)
+{
+    if(to->count + from->count > to->capacity)
+    {
+        size_t capacity = to->capacity ? to->capacity : 64;
+        while(capacity < to->count + from->count) capacity *= 2;
+        char **names = realloc(to->names, capacity*sizeof(*names));
+        if(names == NULL) return 1;
+        to->names = names;
+        to->capacity = capacity;
+    }
+    if(from->count)
+        memcpy(to->names + to->count, from->names,
+                from->count*sizeof(*from->names));
+    to->count += from->count;
+    from->count = 0;
+    return 0;
+}
+
+static inline void fileListFree(struct fileList *list)
+{
+    for(size_t n = 0; n < list->count; ++n) free(list->names[n]);
+    free(list->names);
+    list->names = NULL;
+    list->count = list->capacity = 0;
+}
+
+static inline int isDirectory(const char *path)
+{
+    struct stat fileStat;
+    return stat(path, &fileStat) == 0 && S_ISDIR(fileStat.st_mode);
+}
+
+/* directories to read and files found, shared by walking threads */
+struct walk
+{
+    struct fileList files, directories;
+    const char *suffix; /* only files with it are taken, NULL for all */
+    size_t busy; /* threads reading directories */
+    uint8_t failed;
+#ifdef WALK_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+#endif /* WALK_THREADS */
+};
+
+/* checks whether name ends with suffix, case is ignored */
+static inline int hasSuffix(const char *name, const char *suffix)
+{
+    size_t length = strlen(name), suffixLength = strlen(suffix);
+    if(length < suffixLength) return 0;
+    for(size_t n = 0; n < suffixLength; ++n)
+        if(tolower((unsigned char)name[length - suffixLength + n]) !=
+                tolower((unsigned char)suffix[n])) return 0;
+    return 1;
+}
+
+/* reads directory path, files in it go to walk->files,
+   directories go to walk->directories */
+/* NOTE: symbolic links to directories are not followed, so there are
+   no loops, symbolic links to files are taken */
+static inline void walkDirectory(struct walk *walk, const char *path)
+{
+    DIR *directory = opendir(path);
+    if(directory == NULL)
+    {
+        fprintf(stderr, "%s: Error opening directory.\n", path);
+        return;
+    }
+    /* names are collected without the lock and added at once */
+    struct fileList files = {NULL, 0, 0}, directories = {NULL, 0, 0};
+    uint8_t failed = 0;
+    struct dirent *entry;
+    while(!failed && (entry = readdir(directory)) != NULL)
+    {
+        const char *name = entry->d_name;
+        if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        int kind = 0; /* 1 is file, 2 is directory */
+#ifdef DT_DIR
+        if(entry->d_type == DT_DIR) kind = 2;
+        else if(entry->d_type == DT_REG) kind = 1;
+        else if(entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN)
+#endif /* DT_DIR */
+        { /* file system doesn't tell, so it has to be asked */
+            size_t length = strlen(path) + 1 + strlen(name) + 1;
+            char *full = malloc(length);
+            if(full == NULL)
+            {
+                failed = 1;
+                break;
+            }
+            snprintf(full, length, "%s/%s", path, name);
+            struct stat fileStat;
+#ifdef S_ISLNK
+            if(lstat(full, &fileStat) == 0 && S_ISDIR(fileStat.st_mode))
+                kind = 2;
+            else
+#endif /* S_ISLNK */
+            if(stat(full, &fileStat) == 0)
+                kind = S_ISREG(fileStat.st_mode) ? 1 :
+#ifdef S_ISLNK
+                    0;
+#else
+                    S_ISDIR(fileStat.st_mode) ? 2 : 0;
+#endif /* S_ISLNK */
+            free(full);
+        }
+        if(kind == 1 && (walk->suffix == NULL || hasSuffix(name, walk->suffix)))
+            failed = fileListAdd(&files, path, name);
+        else if(kind == 2)
+            failed = fileListAdd(&directories, path, name);
+    }
+    closedir(directory);
+
+#ifdef WALK_THREADS
+    pthread_mutex_lock(&walk->lock);
+#endif /* WALK_THREADS */
+    if(failed || fileListMove(&walk->files, &files) ||
+            fileListMove(&walk->directories, &directories))
+        walk->failed = 1;
+#ifdef WALK_THREADS
+    pthread_cond_broadcast(&walk->changed);
+    pthread_mutex_unlock(&walk->lock);
+#endif /* WALK_THREADS */
+    fileListFree(&files);
+    fileListFree(&directories);
+}
+
+/* thread function, reads directories until there is none left
+   and no other thread can find more */
+static inline void *walkDirectories(void *argument)
+{
+    struct walk *walk = argument;
+#ifdef WALK_THREADS
+    pthread_mutex_lock(&walk->lock);
+#endif /* WALK_THREADS */
+    while(!walk->failed)
+    {
+        if(walk->directories.count)
+        {
+            char *path = walk->directories.names[--walk->directories.count];
+            ++walk->busy;
+#ifdef WALK_THREADS
+            pthread_mutex_unlock(&walk->lock);
+#endif /* WALK_THREADS */
+            walkDirectory(walk, path);
+            free(path);
+#ifdef WALK_THREADS
+            pthread_mutex_lock(&walk->lock);
+#endif /* WALK_THREADS */
+            --walk->busy;
+            continue;
+        }
+        if(walk->busy == 0) break;
+#ifdef WALK_THREADS
+        pthread_cond_wait(&walk->changed, &walk->lock);
+#endif /* WALK_THREADS */
+    }
+#ifdef WALK_THREADS
+    pthread_cond_broadcast(&walk->changed);
+    pthread_mutex_unlock(&walk->lock);
+#endif /* WALK_THREADS */
+    return NULL;
+}
+
+static inline int byName(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* adds all files in directory path and directories inside it to list,
+   sorted by name, with suffix only files ending with it are taken,
+   directories are read by threads threads, returns 0 on success */
+static inline int walkTree(struct fileList *list, const char *path,
+        const char *suffix, size_t threads)
+{
+    struct walk walk = {{NULL, 0, 0}, {NULL, 0, 0}, suffix, 0, 0
+#ifdef WALK_THREADS
+        , PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER
+#endif /* WALK_THREADS */
+    };
+    if(fileListAdd(&walk.directories, path, NULL)) return 1;
+#ifdef WALK_THREADS
+    pthread_t *thread = threads > 1 ? malloc((threads - 1)*sizeof(*thread)) : NULL;
+    size_t started = 0;
+    for(; thread && started < threads - 1; ++started)
+    {
+        if(pthread_create(thread + started, NULL, walkDirectories, &walk))
+            break;
+    }
+#else
+    (void)threads;
+#endif /* WALK_THREADS */
+    walkDirectories(&walk);
+#ifdef WALK_THREADS
+    for(size_t t = 0; t < started; ++t) pthread_join(thread[t], NULL);
+    free(thread);
+#endif /* WALK_THREADS */
+    if(walk.files.count)
+        qsort(walk.files.names, walk.files.count, sizeof(char *), byName);
+    int result = walk.failed || fileListMove(list, &walk.files);
+    fileListFree(&walk.files);
+    fileListFree(&walk.directories);
+    return result;
+}
+
+#endif /* WALK_H */
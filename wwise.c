@@ -0,0 +1,702 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <stdlib.h> /* malloc,free */
+#include <string.h> /* memchr,memcpy,memmove */
+
+#include "wwise.h"
+#include "cpu.h" /* CPU_DISPATCH,CPU_TARGET,CPU_*,cpuDetect */
+#include "decluster.h" /* pickDecluster */
+#include "adpcm.h" /* struct adpcmFormat,pickDecode */
+
+/* These macros let you assign 4 byte string to 4 byte integer and
+initialize static variable because the following line has undefined behavior and
+has to be executed at run time.
+    uint32_t riffMark = *(uint32_t *)"RIFF";
+This is just overkill for 4 bytes:
+    #includes <strings.h>
+    memcpy(&riffMark, "RIFF", 4);
+*/
+/* char,char,char,char */
+/* little endian */
+#define string4ToInt32LE(a,b,c,d)  \
+    (((a) &0xff) << 0*8) |         \
+    (((b) &0xff) << 1*8) |         \
+    (((c) &0xff) << 2*8) |         \
+    (((d) &0xff) << 3*8)
+/* big endian */
+#define string4ToInt32BE(a,b,c,d)  \
+    (((d) &0xff) << 0*8) |         \
+    (((c) &0xff) << 1*8) |         \
+    (((b) &0xff) << 2*8) |         \
+    (((a) &0xff) << 3*8)
+#undef string4ToInt32BE
+#define string4ToInt32(a,b,c,d) string4ToInt32LE(a,b,c,d)
+
+/* NOTE: relies on that pointers when cast from (uint8_t *) to (uint32_t *)
+work as usual when dereferenced, which, as far as I can tell,
+is Undefined Behavior, and can be compiled in unexpected ways
+so, you should probably compile with -fno-strict-aliasing */
+
+size_t wwiseRiffLength(const uint8_t *p)
+{
+    static uint32_t waveMark = string4ToInt32('W','A','V','E');
+    static uint32_t  fmtMark = string4ToInt32('f','m','t',' ');
+    uint32_t length = *(uint32_t *)(p+4),
+             fmtLength = *(uint32_t *)(p+16);
+    if(*(uint32_t *)(p+8) != waveMark || *(uint32_t *)(p+12) != fmtMark)
+        return 0;
+    /* NOTE: 16 is the smallest "fmt " chunk (PCM),
+       40 is WAVE_FORMAT_EXTENSIBLE, anything much bigger is garbage */
+    if(fmtLength < 16 || fmtLength > 256)
+        return 0;
+    /* "WAVE" and the whole "fmt " chunk have to fit */
+    if(length < 4 + 8 + fmtLength || length > (uint32_t)-1 - 8)
+        return 0;
+    return (size_t)length + 8;
+}
+
+/* [p, end) is searched for "RIFF" by the function of the level
+   of vector code the processor supports (or the one that is forced) */
+typedef const uint8_t *findRiffFunction(const uint8_t *p, const uint8_t *end);
+
+/* -1 until it is known */
+static int cpuLevel = -1;
+static findRiffFunction *findRiff = NULL;
+
+static const uint8_t *findRiffGeneric(const uint8_t *p, const uint8_t *end)
+{
+    if(end - p < 4) return end;
+    /* every possible start of "RIFF" lies in [p, last) */
+    const uint8_t *last = end - 3;
+    while(p < last && (p = memchr(p, 'R', last - p)) != NULL)
+    {
+        if(p[1] == 'I' && p[2] == 'F' && p[3] == 'F') return p;
+        ++p;
+    }
+    return end;
+}
+
+#ifdef CPU_DISPATCH
+/* NOTE: vector versions compare 4 shifted loads with 'R','I','F','F'
+   at once, so every byte of input is compared only with one vector load
+   per letter and nothing but the final match is checked byte by byte,
+   what is left at the end goes to the smaller version */
+CPU_TARGET("sse2")
+static const uint8_t *findRiffSse2(const uint8_t *p, const uint8_t *end)
+{
+    const __m128i r = _mm_set1_epi8('R'),
+                  i = _mm_set1_epi8('I'),
+                  f = _mm_set1_epi8('F');
+    for(; end - p >= 16 + 3; p += 16)
+    {
+        __m128i match = _mm_and_si128(
+                _mm_and_si128(
+                    _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), r),
+                    _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p+1)), i)),
+                _mm_and_si128(
+                    _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p+2)), f),
+                    _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p+3)), f)));
+        uint32_t bits = (uint32_t)_mm_movemask_epi8(match);
+        if(bits) return p + __builtin_ctz(bits);
+    }
+    return findRiffGeneric(p, end);
+}
+
+CPU_TARGET("avx2")
+static const uint8_t *findRiffAvx2(const uint8_t *p, const uint8_t *end)
+{
+    const __m256i r = _mm256_set1_epi8('R'),
+                  i = _mm256_set1_epi8('I'),
+                  f = _mm256_set1_epi8('F');
+    for(; end - p >= 32 + 3; p += 32)
+    {
+        __m256i match = _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), r),
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p+1)), i)),
+                _mm256_and_si256(
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p+2)), f),
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p+3)), f)));
+        uint32_t bits = (uint32_t)_mm256_movemask_epi8(match);
+        if(bits) return p + __builtin_ctz(bits);
+    }
+    return findRiffSse2(p, end);
+}
+
+CPU_TARGET("avx512f,avx512bw")
+static const uint8_t *findRiffAvx512(const uint8_t *p, const uint8_t *end)
+{
+    const __m512i r = _mm512_set1_epi8('R'),
+                  i = _mm512_set1_epi8('I'),
+                  f = _mm512_set1_epi8('F');
+    for(; end - p >= 64 + 3; p += 64)
+    {
+        uint64_t bits =
+            _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(p), r) &
+            _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(p+1), i) &
+            _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(p+2), f) &
+            _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(p+3), f);
+        if(bits) return p + __builtin_ctzll(bits);
+    }
+    return findRiffAvx2(p, end);
+}
+#endif /* CPU_DISPATCH */
+
+int wwiseCpuLevel(void)
+{
+    if(cpuLevel < 0) wwiseSetCpuLevel(cpuDetect());
+    return cpuLevel;
+}
+
+int wwiseSetCpuLevel(int level)
+{
+    if(level < 0 || level >= CPU_LEVELS || level > cpuDetect()) return 1;
+    static findRiffFunction *const functions[CPU_LEVELS] = {
+        findRiffGeneric,
+#ifdef CPU_DISPATCH
+        findRiffSse2, findRiffAvx2, findRiffAvx512
+#else
+        findRiffGeneric, findRiffGeneric, findRiffGeneric
+#endif /* CPU_DISPATCH */
+    };
+    findRiff = functions[level];
+    cpuLevel = level;
+    return 0;
+}
+
+const uint8_t *wwiseFindRiff(const uint8_t *p, const uint8_t *end)
+{
+    /* NOTE: programs with threads choose it before they start them */
+    if(findRiff == NULL) wwiseCpuLevel();
+    return findRiff(p, end);
+}
+
+int wwiseReformatFmt(uint8_t *fmt)
+{
+    uint16_t formatID = *(uint16_t *)fmt,
+             channels = *(uint16_t *)(fmt+2),
+             align = *(uint16_t *)(fmt+12),
+             sampleBits = *(uint16_t *)(fmt+14),
+             extraSize = *(uint16_t *)(fmt+16);
+    if(!( formatID == 0x0002 && sampleBits == 4 && extraSize == 6 &&
+                channels != 0 ))
+        return 0;
+    /* wFormatTag */
+    *(uint16_t *)fmt = 0x0011;
+    /* wSamplesPerBlock */
+    *(uint16_t *)(fmt+18) = (align-4*channels)*8/(sampleBits*channels)+1;
+    /* TODO: dwChannelMask */
+    return 1;
+}
+
+void wwiseScannerInit(struct wwiseScanner *scanner, uint8_t trustLength,
+        wwiseBeginFunction *begin, wwiseDataFunction *data,
+        wwiseEndFunction *end, void *user)
+{
+    scanner->begin = begin;
+    scanner->data = data;
+    scanner->end = end;
+    scanner->user = user;
+    scanner->trustLength = trustLength;
+    scanner->size = 0;
+    scanner->inFile = 0;
+    scanner->offset = scanner->left = 0;
+    scanner->pendingLength = 0;
+}
+
+/* splits [p, end) that starts at scanner->offset of the stream,
+   "RIFF" is searched only where the whole header can be checked
+   (or anywhere when the stream has ended),
+   consumed is set to the number of bytes done with (passed to callbacks
+   or skipped), the rest has to be given again with more bytes after it,
+   returns 0 or what a callback returned */
+static int scan(struct wwiseScanner *scanner, const uint8_t *begin,
+        const uint8_t *end, uint8_t endOfStream, size_t *consumed)
+{
+    const uint8_t *p = begin,
+                  /* "RIFF" is searched only before inspectEnd */
+                  *inspectEnd = endOfStream ? end :
+                      end - begin < WWISE_HEADER_SIZE ? begin :
+                      end - (WWISE_HEADER_SIZE - 1);
+    int result = 0;
+    while(1)
+    {
+        if(scanner->left)
+        { /* length of the file is known, just pass it */
+            size_t amount = end - p;
+            if(amount > scanner->left) amount = scanner->left;
+            if(amount && (result = scanner->data(scanner->user, p, amount)))
+                break;
+            scanner->left -= amount;
+            p += amount;
+            if(scanner->left) break; /* needs more data */
+            scanner->inFile = 0;
+            if((result = scanner->end(scanner->user))) break;
+        }
+        /* NOTE: "RIFF" can be shorter then recorded, so when there is
+           another "RIFF" sequence it is the start of another file,
+           unless recorded length is trusted */
+        const uint8_t *found = p >= inspectEnd ? end :
+            wwiseFindRiff(p, endOfStream ? end : inspectEnd + 3);
+        if(found >= inspectEnd)
+        {
+            if(p < inspectEnd)
+            {
+                if(scanner->inFile &&
+                        (result = scanner->data(scanner->user, p, inspectEnd - p)))
+                    break;
+                p = inspectEnd;
+            }
+            break;
+        }
+        if(scanner->inFile)
+        {
+            if(found > p &&
+                    (result = scanner->data(scanner->user, p, found - p)))
+                break;
+            scanner->inFile = 0;
+            if((result = scanner->end(scanner->user))) break;
+        }
+        p = found;
+        uint64_t length = 0;
+        if(scanner->trustLength && end - found >= WWISE_HEADER_SIZE)
+            length = wwiseRiffLength(found);
+        /* file that claims to be longer then the stream is cut anyway,
+           as extract does with mapped files */
+        if(scanner->size && length > scanner->size - scanner->offset -
+                (uint64_t)(found - begin))
+            length = 0;
+        scanner->inFile = 1;
+        if((result = scanner->begin(scanner->user,
+                        scanner->offset + (found - begin), length)))
+            break;
+        if(length)
+        {
+            scanner->left = length;
+        }
+        else
+        {
+            if((result = scanner->data(scanner->user, found, 4))) break;
+            p = found + 4;
+        }
+    }
+    *consumed = p - begin;
+    scanner->offset += p - begin;
+    return result;
+}
+
+int wwiseScannerFeed(struct wwiseScanner *scanner,
+        const uint8_t *data, size_t size)
+{
+    size_t consumed;
+    int result;
+    if(scanner->pendingLength)
+    {
+        /* NOTE: with WWISE_HEADER_SIZE bytes after them, pending bytes
+           are always consumed, so it is enough to add that much */
+        size_t old = scanner->pendingLength,
+               added = sizeof(scanner->pending) - old;
+        if(added > size) added = size;
+        memcpy(scanner->pending + old, data, added);
+        scanner->pendingLength += added;
+        result = scan(scanner, scanner->pending,
+                scanner->pending + scanner->pendingLength, 0, &consumed);
+        if(result) return result;
+        if(consumed < old)
+        { /* all of data is in pending */
+            scanner->pendingLength -= consumed;
+            memmove(scanner->pending, scanner->pending + consumed,
+                    scanner->pendingLength);
+            return 0;
+        }
+        scanner->pendingLength = 0;
+        data += consumed - old;
+        size -= consumed - old;
+    }
+    result = scan(scanner, data, data + size, 0, &consumed);
+    if(result) return result;
+    /* NOTE: less then WWISE_HEADER_SIZE is left */
+    scanner->pendingLength = size - consumed;
+    memcpy(scanner->pending, data + consumed, scanner->pendingLength);
+    return 0;
+}
+
+int wwiseScannerFinish(struct wwiseScanner *scanner)
+{
+    size_t consumed;
+    int result = scan(scanner, scanner->pending,
+            scanner->pending + scanner->pendingLength, 1, &consumed);
+    scanner->pendingLength = 0;
+    if(result) return result;
+    /* the last file ends with the stream, even when it is shorter
+       then recorded */
+    scanner->left = 0;
+    if(scanner->inFile)
+    {
+        scanner->inFile = 0;
+        return scanner->end(scanner->user);
+    }
+    return 0;
+}
+
+/* states of wwiseTransform */
+enum
+{
+    TRANSFORM_RIFF, /* head is "RIFF", length, "WAVE" */
+    TRANSFORM_CHUNK, /* head is chunk header */
+    TRANSFORM_FMT, /* head is "fmt " chunk with its header */
+    TRANSFORM_SKIP, /* left bytes of chunk are passed as is */
+    TRANSFORM_DATA, /* left blocks of data are changed */
+    TRANSFORM_PASS /* the rest of the file is passed as is */
+};
+
+void wwiseTransformInit(struct wwiseTransform *transform,
+        wwiseDataFunction *output, void *user)
+{
+    transform->output = output;
+    transform->user = user;
+    transform->state = TRANSFORM_RIFF;
+    transform->changed = 0;
+    transform->have = 0;
+    transform->left = 0;
+    transform->blockHave = 0;
+}
+
+/* NOTE: chunks are searched from the start of the file without padding,
+   like findChunk() of reformat.c does, the first "fmt " chunk has to be
+   24 bytes of Wwise IMA ADPCM and it has to be before "data" chunk,
+   otherwise the file is passed as is */
+int wwiseTransformFeed(struct wwiseTransform *transform,
+        const uint8_t *data, size_t size)
+{
+    static uint32_t waveMark = string4ToInt32('W','A','V','E');
+    static uint32_t  fmtMark = string4ToInt32('f','m','t',' ');
+    static uint32_t dataMark = string4ToInt32('d','a','t','a');
+    struct wwiseTransform *t = transform;
+    int result;
+    while(size)
+    {
+        if(t->state == TRANSFORM_PASS)
+        {
+            return t->output(t->user, data, size);
+        }
+        if(t->state == TRANSFORM_SKIP)
+        {
+            size_t amount = size < t->left ? size : t->left;
+            if((result = t->output(t->user, data, amount))) return result;
+            data += amount;
+            size -= amount;
+            t->left -= amount;
+            if(t->left == 0) t->state = TRANSFORM_CHUNK;
+            continue;
+        }
+        if(t->state == TRANSFORM_DATA)
+        {
+            if(t->blockHave || size < t->align)
+            { /* block is split between feeds */
+                size_t amount = t->align - t->blockHave;
+                if(amount > size) amount = size;
+                memcpy((uint8_t *)t->block + t->blockHave, data, amount);
+                data += amount;
+                size -= amount;
+                t->blockHave += amount;
+                if(t->blockHave < t->align) return 0;
+                t->decluster(t->out, t->block, t->channels, t->words);
+                if((result = t->output(t->user, (uint8_t *)t->out, t->align)))
+                    return result;
+                t->blockHave = 0;
+                --t->left;
+            }
+            else
+            { /* whole blocks are changed straight from data */
+                /* NOTE: nBlockAlign is 16 bit, so at least one block fits */
+                size_t blocks = size / t->align;
+                if(blocks > sizeof(t->out) / t->align)
+                    blocks = sizeof(t->out) / t->align;
+                if(blocks > t->left) blocks = t->left;
+                for(size_t block = 0; block < blocks; ++block)
+                    t->decluster(t->out + block*t->align/4,
+                            (const uint32_t *)(data + block*t->align),
+                            t->channels, t->words);
+                if((result = t->output(t->user, (uint8_t *)t->out,
+                                blocks*t->align)))
+                    return result;
+                data += blocks*t->align;
+                size -= blocks*t->align;
+                t->left -= blocks;
+            }
+            /* NOTE: only blocks of data chunk are changed,
+               the last one can be partially outside of it */
+            if(t->left == 0) t->state = TRANSFORM_PASS;
+            continue;
+        }
+
+        /* collect head */
+        size_t need = t->state == TRANSFORM_RIFF ? 12 :
+            t->state == TRANSFORM_CHUNK ? 8 : 8 + 24;
+        size_t amount = need - t->have;
+        if(amount > size) amount = size;
+        memcpy(t->head + t->have, data, amount);
+        data += amount;
+        size -= amount;
+        t->have += amount;
+        if(t->have < need) return 0;
+
+        uint32_t mark = *(uint32_t *)t->head,
+                 length = *(uint32_t *)(t->head+4);
+        if(t->state == TRANSFORM_RIFF)
+        {
+            t->state = *(uint32_t *)(t->head+8) == waveMark ?
+                TRANSFORM_CHUNK : TRANSFORM_PASS;
+        }
+        else if(t->state == TRANSFORM_FMT)
+        {
+            if(!wwiseReformatFmt(t->head + 8))
+            {
+                t->state = TRANSFORM_PASS;
+            }
+            else
+            {
+                t->changed = 1;
+                t->channels = *(uint16_t *)(t->head+8+2);
+                t->align = *(uint16_t *)(t->head+8+12);
+                t->words = t->align/(t->channels*4);
+                t->state = TRANSFORM_CHUNK;
+            }
+        }
+        else if(!t->changed && mark == fmtMark)
+        {
+            if(length == 24)
+            { /* the rest of "fmt " chunk is needed */
+                t->state = TRANSFORM_FMT;
+                continue;
+            }
+            t->state = TRANSFORM_PASS;
+        }
+        else if(mark == dataMark && length)
+        {
+            if(t->changed && t->channels > 1 && t->words)
+            {
+                t->decluster = pickDecluster(t->channels, wwiseCpuLevel());
+                t->left = ((uint64_t)length + t->align - 1) / t->align;
+                t->state = TRANSFORM_DATA;
+            }
+            else
+            {
+                t->state = TRANSFORM_PASS;
+            }
+        }
+        else
+        {
+            t->left = length;
+            t->state = length ? TRANSFORM_SKIP : TRANSFORM_CHUNK;
+        }
+        result = t->output(t->user, t->head, t->have);
+        t->have = 0;
+        if(result) return result;
+    }
+    return 0;
+}
+
+int wwiseTransformFinish(struct wwiseTransform *transform)
+{
+    /* incomplete header or block is passed as is */
+    int result = 0;
+    if(transform->have)
+        result = transform->output(transform->user, transform->head,
+                transform->have);
+    else if(transform->blockHave)
+        result = transform->output(transform->user,
+                (uint8_t *)transform->block, transform->blockHave);
+    transform->have = transform->blockHave = 0;
+    return result;
+}
+
+/* finds chunk of RIFF WAVE file, starting with chunk at offset,
+   sets offset to its data and length to its length,
+   returns 0 when it is found */
+/* NOTE: chunks are not padded, as in findChunk() of decode.c */
+static int findChunk(struct wwiseDecoder *decoder, uint32_t chunkMark,
+        uint64_t *offset, uint32_t *length)
+{
+    while(1)
+    {
+        uint32_t chunkHead[2];
+        if(decoder->read(decoder->user, chunkHead, 8, *offset) < 8) return 1;
+        *offset += 8;
+        if(chunkHead[0] == chunkMark)
+        {
+            *length = chunkHead[1];
+            return 0;
+        }
+        *offset += chunkHead[1];
+    }
+}
+
+int wwiseDecoderOpen(struct wwiseDecoder *decoder, wwiseReadFunction *read,
+        void *user, size_t cacheBlocks)
+{
+    static uint32_t riffMark = string4ToInt32('R','I','F','F');
+    static uint32_t waveMark = string4ToInt32('W','A','V','E');
+    static uint32_t  fmtMark = string4ToInt32('f','m','t',' ');
+    static uint32_t dataMark = string4ToInt32('d','a','t','a');
+    static uint32_t factMark = string4ToInt32('f','a','c','t');
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->read = read;
+    decoder->user = user;
+    uint32_t magick[3] = {0,0,0};
+    if(read(user, magick, 4*3, 0) < 4*3 ||
+            magick[0] != riffMark || magick[2] != waveMark)
+        return 1;
+    /* "data" is after "fmt " */
+    uint64_t offset = 12;
+    uint32_t fmtLength, dataLength;
+    uint8_t fmt[24];
+    if(findChunk(decoder, fmtMark, &offset, &fmtLength) ||
+            fmtLength < 20 || fmtLength > 24 ||
+            read(user, fmt, fmtLength, offset) < fmtLength)
+        return 1;
+    offset += fmtLength;
+    if(findChunk(decoder, dataMark, &offset, &dataLength)) return 1;
+    uint16_t formatID = *(uint16_t *)fmt,
+             sampleBits = *(uint16_t *)(fmt+14),
+             extraSize = *(uint16_t *)(fmt+16);
+    /* Wwise IMA ADPCM, or IMA ADPCM (reformatted one too) */
+    if(!(sampleBits == 4 && ((formatID == 0x0002 && extraSize == 6) ||
+                    (formatID == 0x0011 && extraSize >= 2))))
+        return 1;
+    decoder->channels = *(uint16_t *)(fmt+2);
+    decoder->rate = *(uint32_t *)(fmt+4);
+    decoder->align = *(uint16_t *)(fmt+12);
+    decoder->clustered = formatID == 0x0002;
+    decoder->words = decoder->channels ?
+        decoder->align/(decoder->channels*4) : 0;
+    if(decoder->words < 2) return 1;
+    decoder->blockSamples = (decoder->words - 1)*8 + 1;
+    decoder->dataOffset = offset;
+    /* NOTE: incomplete last block is not decoded */
+    decoder->blocks = dataLength / decoder->align;
+    decoder->samples = decoder->blocks*decoder->blockSamples;
+    /* NOTE: "fact" chunk (encode writes it) tells how much samples
+       there are when the last block is filled up */
+    uint64_t factOffset = 12;
+    uint32_t factLength, factSamples;
+    if(findChunk(decoder, factMark, &factOffset, &factLength) == 0 &&
+            factLength >= 4 &&
+            read(user, &factSamples, 4, factOffset) == 4 &&
+            factSamples && factSamples < decoder->samples)
+        decoder->samples = factSamples;
+
+    decoder->cacheBlocks = cacheBlocks ? cacheBlocks : 64;
+    size_t blockSize = decoder->blockSamples*decoder->channels;
+    decoder->cached = malloc(decoder->cacheBlocks*sizeof(uint64_t));
+    decoder->used = malloc(decoder->cacheBlocks*sizeof(uint64_t));
+    decoder->cache = malloc(decoder->cacheBlocks*blockSize*2);
+    decoder->data = malloc(decoder->cacheBlocks*decoder->align);
+    decoder->decoded = malloc(decoder->cacheBlocks*blockSize*2);
+    if(decoder->cached == NULL || decoder->used == NULL ||
+            decoder->cache == NULL || decoder->data == NULL ||
+            decoder->decoded == NULL)
+    {
+        wwiseDecoderClose(decoder);
+        return 2;
+    }
+    for(size_t n = 0; n < decoder->cacheBlocks; ++n)
+    {
+        decoder->cached[n] = (uint64_t)-1;
+        decoder->used[n] = 0;
+    }
+    return 0;
+}
+
+/* returns place of block in cache, cacheBlocks when it is not there */
+static size_t findBlock(const struct wwiseDecoder *decoder, uint64_t block)
+{
+    size_t n = 0;
+    while(n < decoder->cacheBlocks && decoder->cached[n] != block) ++n;
+    return n;
+}
+
+/* reads and decodes block and blocks after it up to last that are not
+   in cache (as much as cache holds) with one read, puts them into
+   places used the longest time ago,
+   returns place of block, cacheBlocks when it can't be read */
+static size_t loadBlocks(struct wwiseDecoder *decoder, uint64_t block,
+        uint64_t last)
+{
+    size_t count = 1;
+    while(count < decoder->cacheBlocks && block + count <= last &&
+            findBlock(decoder, block + count) == decoder->cacheBlocks)
+        ++count;
+    count = decoder->read(decoder->user, decoder->data, count*decoder->align,
+            decoder->dataOffset + block*decoder->align) / decoder->align;
+    if(count == 0) return decoder->cacheBlocks;
+
+    struct adpcmFormat format = {decoder->channels, decoder->align,
+        decoder->words, decoder->blockSamples, decoder->clustered};
+    pickDecode(wwiseCpuLevel())(decoder->decoded, decoder->data, count,
+            &format);
+    size_t blockSize = decoder->blockSamples*decoder->channels, first = 0;
+    for(size_t n = 0; n < count; ++n)
+    {
+        size_t oldest = 0;
+        for(size_t m = 1; m < decoder->cacheBlocks; ++m)
+            if(decoder->used[m] < decoder->used[oldest]) oldest = m;
+        memcpy(decoder->cache + oldest*blockSize,
+                decoder->decoded + n*blockSize, blockSize*2);
+        decoder->cached[oldest] = block + n;
+        /* NOTE: blocks just read are the newest,
+           so they don't replace each other */
+        decoder->used[oldest] = ++decoder->clock;
+        if(n == 0) first = oldest;
+    }
+    return first;
+}
+
+size_t wwiseDecoderRead(struct wwiseDecoder *decoder, int16_t *out,
+        uint64_t first, size_t count)
+{
+    if(first >= decoder->samples) return 0;
+    if(count > decoder->samples - first) count = decoder->samples - first;
+    size_t channels = decoder->channels,
+           blockSamples = decoder->blockSamples, done = 0;
+    uint64_t last = (first + count - 1) / blockSamples;
+    while(done < count)
+    {
+        uint64_t sample = first + done, block = sample / blockSamples;
+        size_t place = findBlock(decoder, block);
+        if(place == decoder->cacheBlocks)
+            place = loadBlocks(decoder, block, last);
+        if(place == decoder->cacheBlocks) break;
+        decoder->used[place] = ++decoder->clock;
+        size_t skip = sample - block*blockSamples,
+               amount = blockSamples - skip;
+        if(amount > count - done) amount = count - done;
+        memcpy(out + done*channels,
+                decoder->cache + (place*blockSamples + skip)*channels,
+                amount*channels*2);
+        done += amount;
+    }
+    return done;
+}
+
+void wwiseDecoderClose(struct wwiseDecoder *decoder)
+{
+    free(decoder->cached);
+    free(decoder->used);
+    free(decoder->cache);
+    free(decoder->data);
+    free(decoder->decoded);
+    decoder->cached = decoder->used = NULL;
+    decoder->cache = decoder->decoded = NULL;
+    decoder->data = NULL;
+}
@@ -0,0 +1,175 @@
+/* The MIT License (MIT)
+Copyright (c) 2016 Victor Dmitriyev
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Finding RIFF files in a stream of bytes and changing Wwise IMA ADPCM
+   wave files into usual IMA ADPCM wave files, as extract and reformat do,
+   without files and processes: bytes are pushed in by the caller
+   and results come out through callbacks.
+   Decoding of any part of a wave file, as decode does.
+   Compile wwise.c with the program, like extract and reformat are. */
+#ifndef WWISE_H
+#define WWISE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* bytes needed to check header of RIFF WAVE file:
+   "RIFF", length, "WAVE", "fmt ", fmt length and the smallest fmt chunk */
+#define WWISE_HEADER_SIZE 36
+
+/* returns pointer to the first "RIFF" that lies entirely inside [p, end)
+   or end if there is no such "RIFF" */
+const uint8_t *wwiseFindRiff(const uint8_t *p, const uint8_t *end);
+
+/* level of vector code used by the library: 0 is generic C,
+   1 is SSE2, 2 is AVX2, 3 is AVX-512 (F and BW), on x86 with GCC or clang,
+   the best one the processor supports is chosen the first time it is needed,
+   so programs with threads call it before they start them */
+int wwiseCpuLevel(void);
+
+/* forces level of vector code (for benchmarks), returns 0 on success,
+   1 when the processor doesn't support it, call it before anything else */
+int wwiseSetCpuLevel(int level);
+
+/* checks WWISE_HEADER_SIZE bytes at p (which start with "RIFF") and
+   returns length of the whole RIFF file as recorded in it,
+   or 0 when header doesn't look like RIFF WAVE file header */
+size_t wwiseRiffLength(const uint8_t *p);
+
+/* checks 24 bytes "fmt " chunk of Wwise IMA ADPCM wave file and changes it
+   into IMA ADPCM one, returns 1 when it is changed,
+   0 when it is not Wwise IMA ADPCM (fmt is left as is) */
+int wwiseReformatFmt(uint8_t *fmt);
+
+/* callbacks return 0 to go on, anything else stops the work
+   and is returned by the function that called them */
+/* RIFF file found at offset of the stream, length is recorded length
+   when it is trusted (and the file ends after that much bytes),
+   0 when the file ends at the next "RIFF" */
+typedef int wwiseBeginFunction(void *user, uint64_t offset, uint64_t length);
+/* next bytes of the current RIFF file (or of transformed file) */
+typedef int wwiseDataFunction(void *user, const uint8_t *data, size_t size);
+/* the current RIFF file has ended */
+typedef int wwiseEndFunction(void *user);
+
+/* splits stream of bytes by "RIFF" marks, as extract does,
+   bytes before the first "RIFF" are skipped */
+/* NOTE: last WWISE_HEADER_SIZE-1 bytes of every feed are inspected only
+   with the next one (or by wwiseScannerFinish()), so every "RIFF"
+   is checked with the whole header, they are copied in the scanner,
+   everything else is passed to callbacks straight from the caller's buffer */
+struct wwiseScanner
+{
+    wwiseBeginFunction *begin;
+    wwiseDataFunction *data;
+    wwiseEndFunction *end;
+    void *user;
+    /* stop at recorded RIFF length when header looks right (extract -l) */
+    uint8_t trustLength;
+    /* bytes of the whole stream when they are known (0 when they are not,
+       set after wwiseScannerInit()), recorded lengths that go past
+       its end are not trusted, otherwise they are trusted up to the end */
+    uint64_t size;
+    /* the rest is for wwise.c only */
+    uint8_t inFile;
+    uint64_t offset; /* of the first byte of pending in the stream */
+    uint64_t left; /* bytes of current file left when its length is known */
+    size_t pendingLength;
+    uint8_t pending[2*WWISE_HEADER_SIZE];
+};
+
+void wwiseScannerInit(struct wwiseScanner *scanner, uint8_t trustLength,
+        wwiseBeginFunction *begin, wwiseDataFunction *data,
+        wwiseEndFunction *end, void *user);
+/* pushes size bytes of the stream, returns 0 or what a callback returned */
+int wwiseScannerFeed(struct wwiseScanner *scanner,
+        const uint8_t *data, size_t size);
+/* the stream has ended, returns 0 or what a callback returned */
+int wwiseScannerFinish(struct wwiseScanner *scanner);
+
+/* changes one RIFF file pushed in pieces the same way reformat would
+   change it and passes the result to output, files that are not
+   Wwise IMA ADPCM come out as they are */
+/* NOTE: it is about 128 KiB, keep it off small stacks */
+struct wwiseTransform
+{
+    wwiseDataFunction *output;
+    void *user;
+    /* set when "fmt " chunk is changed, so the file is Wwise IMA ADPCM */
+    uint8_t changed;
+    /* the rest is for wwise.c only */
+    uint8_t state;
+    size_t have; /* bytes in head */
+    uint8_t head[8 + 24]; /* RIFF header, chunk header or "fmt " chunk */
+    uint64_t left; /* bytes of chunk to pass as is, blocks of data to change */
+    size_t channels, words, align, blockHave;
+    void (*decluster)(uint32_t *out, const uint32_t *in,
+            size_t channels, size_t words);
+    uint32_t block[(1 << 16)/4]; /* incomplete block */
+    uint32_t out[(1 << 16)/4];
+};
+
+void wwiseTransformInit(struct wwiseTransform *transform,
+        wwiseDataFunction *output, void *user);
+/* pushes size bytes of the file, returns 0 or what output returned */
+int wwiseTransformFeed(struct wwiseTransform *transform,
+        const uint8_t *data, size_t size);
+/* the file has ended, returns 0 or what output returned */
+int wwiseTransformFinish(struct wwiseTransform *transform);
+
+/* reads up to size bytes at offset of the file into buffer,
+   returns how much bytes were read (less at the end of the file) */
+typedef size_t wwiseReadFunction(void *user, void *buffer, size_t size,
+        uint64_t offset);
+
+/* decodes any range of samples of Wwise IMA ADPCM wave file (or IMA ADPCM
+   one changed by reformat) into 16 bit samples, as decode does,
+   reading only the blocks the range is in, so it takes the same time
+   at the start and at the end of a file of any length */
+/* NOTE: the last decoded blocks are kept (the ones used the longest time
+   ago are replaced first), so going back and forth over the same place
+   doesn't read and decode it again, the cache is searched block by block,
+   so it should be small, a few dozen blocks,
+   one decoder is used by one thread at a time */
+struct wwiseDecoder
+{
+    wwiseReadFunction *read;
+    void *user;
+    /* format of the file, set by wwiseDecoderOpen() */
+    uint32_t rate;
+    size_t channels;
+    uint64_t samples; /* of every channel, in complete blocks
+                         (up to the number in "fact" chunk when there is one) */
+    /* the rest is for wwise.c only */
+    size_t align, words, blockSamples;
+    uint8_t clustered;
+    uint64_t dataOffset, blocks;
+    size_t cacheBlocks;
+    uint64_t clock; /* the last time a block was used */
+    uint64_t *cached, *used; /* block in every place of cache and its time */
+    int16_t *cache; /* decoded blocks, cacheBlocks of them */
+    uint8_t *data; /* read blocks */
+    int16_t *decoded; /* decoded read blocks */
+};
+
+/* reads header of the file through read, with cacheBlocks decoded blocks
+   kept (0 for the default 64), returns 0 on success,
+   1 when the file is not (Wwise) IMA ADPCM wave file or it can't be read,
+   2 when there is not enough memory */
+int wwiseDecoderOpen(struct wwiseDecoder *decoder, wwiseReadFunction *read,
+        void *user, size_t cacheBlocks);
+/* decodes count samples of every channel starting with sample first
+   into out (channels interleaved), returns the number of samples done,
+   it is less then count only at the end of the file or on read error */
+size_t wwiseDecoderRead(struct wwiseDecoder *decoder, int16_t *out,
+        uint64_t first, size_t count);
+void wwiseDecoderClose(struct wwiseDecoder *decoder);
+
+#endif /* WWISE_H */